@@ -1,27 +1,692 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
+#include <generator.h>
+#include <hardware_counters.h>
+#include <memory_usage.h>
 #include <parser.h>
+#include <thread_pool.h>
+#include <trace.h>
 
 namespace py = pybind11;
 
-PYBIND11_MODULE(openqasmparser, m) {
+// Copy a two-dimensional parameter matrix (numpy array or nested sequence) into rows of parameter values
+static std::vector<std::vector<double> > parameterRows(
+        const py::array_t<double, py::array::c_style | py::array::forcecast> &values) {
+  if (values.ndim() != 2)
+    throw std::invalid_argument("Parameter matrix must be two-dimensional!");
+
+  const auto rows = static_cast<std::size_t>(values.shape(0));
+  const auto cols = static_cast<std::size_t>(values.shape(1));
+  const double *data = values.data();
+
+  std::vector<std::vector<double> > matrix(rows);
+  for (std::size_t row = 0; row < rows; row++)
+    matrix[row].assign(data + row * cols, data + (row + 1) * cols);
+  return matrix;
+}
+
+// An explicitly requested backend takes precedence over the `use_omp` flag
+static qasmparser::Backend backendOf(bool useOpenMP, const std::optional<qasmparser::Backend> &backend) {
+  if (backend)
+    return backend.value();
+  return useOpenMP ? qasmparser::Backend::OpenMP : qasmparser::Backend::ExecutionPolicy;
+}
+
+// Backend of a compile running on a worker of the pool. Every worker would start an OpenMP team of its own and
+// concurrent compiles would oversubscribe the cores, so parallel loops run as tasks of the pool's arena instead.
+static qasmparser::Backend onWorker(const qasmparser::Backend backend) {
+  return backend == qasmparser::Backend::Sequential ? backend : qasmparser::Backend::ExecutionPolicy;
+}
+
+// Token of a call, expiring at the latest after the optional time budget
+static qasmparser::CancellationToken tokenOf(const std::optional<qasmparser::CancellationToken> &cancel,
+                                             const std::optional<double> &timeout) {
+  const auto token = cancel.value_or(qasmparser::CancellationToken());
+  return timeout ? token.withTimeout(timeout.value()) : token;
+}
+
+// Circuit of a compile, paired with a dictionary of its statistics if they were collected
+static py::object withStats(const std::string &qasm, const std::optional<qasmparser::CompileStats> &stats) {
+  if (!stats)
+    return py::str(qasm);
+
+  py::dict timings;
+  timings["read"] = stats->readSeconds;
+  timings["convert"] = stats->convertSeconds;
+  timings["emit"] = stats->emitSeconds;
+  timings["assemble"] = stats->assembleSeconds;
+  timings["write"] = stats->writeSeconds;
+
+  py::dict gates;
+  gates["rz"] = stats->rzGates;
+  gates["cx"] = stats->cxGates;
+  gates["rx"] = stats->rxGates;
+  gates["ry"] = stats->ryGates;
+
+  py::dict dict;
+  dict["seconds"] = timings;
+  dict["bytes_in"] = stats->bytesIn;
+  dict["bytes_out"] = stats->bytesOut;
+  dict["terms"] = stats->terms;
+  dict["parameters"] = stats->parameters;
+  dict["gates"] = gates;
+  dict["threads"] = stats->threads;
+  dict["utilization"] = stats->utilization;
+
+  // Heap usage is only counted by builds with memory accounting
+  if (qasmparser::memoryAccounting()) {
+    py::dict memory;
+    for (const auto &[name, usage] : {std::pair("read", stats->readMemory), std::pair("convert", stats->convertMemory),
+                                      std::pair("emit", stats->emitMemory),
+                                      std::pair("assemble", stats->assembleMemory)}) {
+      py::dict phase;
+      phase["allocations"] = usage.allocations;
+      phase["bytes"] = usage.bytes;
+      phase["peak_bytes"] = usage.peakBytes;
+      phase["retained_bytes"] = usage.retainedBytes;
+      memory[name] = phase;
+    }
+    dict["memory"] = memory;
+  }
+
+  // Hardware events only once enabled and available
+  if (stats->readCounters.valid || stats->emitCounters.valid) {
+    py::dict counters;
+    for (const auto &[name, events] : {std::pair("read", stats->readCounters),
+                                       std::pair("convert", stats->convertCounters),
+                                       std::pair("emit", stats->emitCounters),
+                                       std::pair("assemble", stats->assembleCounters)}) {
+      py::dict phase;
+      phase["cycles"] = events.cycles;
+      phase["instructions"] = events.instructions;
+      phase["cache_misses"] = events.cacheMisses;
+      phase["branch_misses"] = events.branchMisses;
+      counters[name] = phase;
+    }
+    dict["counters"] = counters;
+  }
+  return py::make_tuple(py::str(qasm), dict);
+}
+
+// Python exception corresponding to an exception thrown by the library
+static py::object pythonException(const std::exception_ptr &error) {
+  try {
+    std::rethrow_exception(error);
+  }
+  catch (const qasmparser::Cancelled &exception) {
+    return py::module_::import("openqasmparser").attr("CompileCancelled")(exception.what());
+  }
+  catch (const std::invalid_argument &exception) {
+    return py::reinterpret_borrow<py::object>(PyExc_ValueError)(exception.what());
+  }
+  catch (const std::exception &exception) {
+    return py::reinterpret_borrow<py::object>(PyExc_RuntimeError)(exception.what());
+  }
+  catch (...) {
+    return py::reinterpret_borrow<py::object>(PyExc_RuntimeError)("Unknown Error!");
+  }
+}
+
+// Run a compile on the library's worker pool and return an asyncio future of the running event loop, completed with
+// its result from the worker thread. Cancelling the future cancels the compile through its token. Python objects are
+// only touched while holding the GIL.
+static py::object submitAsync(std::function<std::string()> compile, const qasmparser::CancellationToken &cancel) {
+  struct Pending {
+    py::object loop;
+    py::object future;
+  };
+
+  py::object loop = py::module_::import("asyncio").attr("get_running_loop")();
+  py::object future = loop.attr("create_future")();
+  future.attr("add_done_callback")(py::cpp_function([cancel](const py::object &done) {
+    if (done.attr("cancelled")().cast<bool>())
+      cancel.cancel();
+  }));
+  auto *pending = new Pending{loop, future};
+
+  qasmparser::threadPool()->submit([pending, compile = std::move(compile)]() {
+    std::string qasm;
+    std::exception_ptr error;
+    try {
+      qasm = compile();
+    }
+    catch (...) {
+      error = std::current_exception();
+    }
+
+    py::gil_scoped_acquire gil;
+    try {
+      py::object result = error ? pythonException(error) : py::str(qasm);
+      py::object future = pending->future;
+      const bool failed = static_cast<bool>(error);
+      // The future may have been cancelled in the meantime
+      pending->loop.attr("call_soon_threadsafe")(py::cpp_function([future, result, failed]() {
+        if (!future.attr("done")().cast<bool>())
+          future.attr(failed ? "set_exception" : "set_result")(result);
+      }));
+    }
+    catch (py::error_already_set &) {
+      // Event loop closed before the compile finished, nobody is waiting for the result
+    }
+    delete pending;
+  });
+  return future;
+}
+
+PYBIND11_MODULE(openqasmparser, m, py::mod_gil_not_used()) {
   m.doc() = "Python binding for the OpenQASM parser library.";
-  m.def("parse_circuit", &qasmparser::parseCircuit, "Parse an ansatz into the corresponding OpenQASM representation, "
-                                                    "parallel execution enabled.\n"
-                                                    "@param input_fn: Path to the input file to parse.\n"
-                                                    "@param version: OpenQASM version to use, default 3.\n"
-                                                    "@param use_omp: Use OpenMP parallelism, default execution policy "
-                                                    "parallelism.\n"
-                                                    "@param parameterize: Set true to parameterize the circuit.\n"
-                                                    "@param output_fn: Path to (non-)existing file to store the OpenQASM"
-                                                    "representation file. (optional)\n"
-                                                    "@param multiplier: Floating value to be multiplied to each "
-                                                    "operator. (optional)",
+
+  py::enum_<qasmparser::CoefficientInputs>(m, "CoefficientInputs", "Declaration of operator coefficients as runtime "
+                                                                    "inputs in OpenQASM v3.")
+    .value("OFF", qasmparser::CoefficientInputs::Off)  // Coefficients baked into the rotation angles
+    .value("PER_TERM", qasmparser::CoefficientInputs::PerTerm)  // One input per operator
+    .value("PER_VALUE", qasmparser::CoefficientInputs::PerValue);  // One input per distinct coefficient value
+
+  py::enum_<qasmparser::Backend>(m, "Backend", "Parallel framework of the parallel loops.")
+    .value("SEQUENTIAL", qasmparser::Backend::Sequential)  // Calling thread only
+    .value("OPENMP", qasmparser::Backend::OpenMP)  // OpenMP with dynamic scheduling
+    .value("EXECUTION_POLICY", qasmparser::Backend::ExecutionPolicy)  // C++17 execution policies (TBB)
+    .value("AUTO", qasmparser::Backend::Auto);  // Chosen by amount and distribution of work
+
+  py::class_<qasmparser::Schedule>(m, "Schedule", "Backend and chunking chosen for a parallel loop.")
+    .def_readonly("backend", &qasmparser::Schedule::backend)
+    .def_readonly("grain_size", &qasmparser::Schedule::grainSize)  // 0 for chunks of about equal cost
+    .def_readonly("chunks", &qasmparser::Schedule::chunks)
+    .def("__repr__", [](const qasmparser::Schedule &schedule) {
+      return "Schedule(backend=" + py::repr(py::cast(schedule.backend)).cast<std::string>() +
+             ", grain_size=" + std::to_string(schedule.grainSize) + ", chunks=" + std::to_string(schedule.chunks) +
+             ")";
+    });
+
+  py::enum_<qasmparser::HamiltonianFamily>(m, "HamiltonianFamily", "Structure of synthetic Hamiltonians.")
+    .value("RANDOM_SPARSE", qasmparser::HamiltonianFamily::RandomSparse)  // Weight in [min_weight, max_weight]
+    .value("FIXED_WEIGHT", qasmparser::HamiltonianFamily::FixedWeight)  // Weight exactly min_weight
+    .value("JORDAN_WIGNER", qasmparser::HamiltonianFamily::JordanWigner)  // Long Z strings between X/Y ends
+    .value("LATTICE", qasmparser::HamiltonianFamily::Lattice);  // Nearest-neighbour XX, YY and ZZ
+
+  m.def("generate_hamiltonian",
+        [](const std::optional<std::string> &outFilename,
+           qasmparser::HamiltonianFamily family,
+           unsigned long qubits,
+           std::size_t terms,
+           std::size_t minWeight,
+           std::size_t maxWeight,
+           std::size_t parameters,
+           unsigned long latticeWidth,
+           std::uint64_t seed,
+           qasmparser::Backend backend) -> std::optional<std::string> {
+          qasmparser::GeneratorOptions options;
+          options.family = family;
+          options.qubits = qubits;
+          options.terms = terms;
+          options.minWeight = minWeight;
+          options.maxWeight = maxWeight;
+          options.parameters = parameters;
+          options.latticeWidth = latticeWidth;
+          options.seed = seed;
+          if (!outFilename)
+            return qasmparser::generateHamiltonian(options, backend);
+          qasmparser::writeHamiltonian(options, outFilename.value(), backend);
+          return std::nullopt;
+        },
+        "Generate a seeded synthetic Hamiltonian in the input format, in parallel. The same options always produce "
+        "the same Hamiltonian.\n"
+        "@param output_fn: File to write; if not provided the Hamiltonian is returned as text. (optional)\n"
+        "@param family: Structure of the Pauli strings, default RANDOM_SPARSE.\n"
+        "@param qubits: Number of qubits.\n"
+        "@param terms: Number of terms.\n"
+        "@param min_weight: Smallest number of active qubits of a term.\n"
+        "@param max_weight: Largest number of active qubits of a term.\n"
+        "@param parameters: Number of distinct shared parameters, 0 for independent terms.\n"
+        "@param lattice_width: Sites per row of the LATTICE family, 0 for a chain.\n"
+        "@param seed: Seed of the generator.\n"
+        "@param backend: Parallel framework, default AUTO.\n"
+        "@return: Hamiltonian text, or None if written to output_fn.",
+        py::arg_v("output_fn", std::nullopt, "None"),  // Optional output file name
+        py::kw_only(),
+        py::arg("family") = qasmparser::HamiltonianFamily::RandomSparse,
+        py::arg("qubits") = 16,
+        py::arg("terms") = 1000,
+        py::arg("min_weight") = 2,
+        py::arg("max_weight") = 4,
+        py::arg("parameters") = 0,
+        py::arg("lattice_width") = 0,
+        py::arg("seed") = 1,
+        py::arg("backend") = qasmparser::Backend::Auto,
+        py::call_guard<py::gil_scoped_release>());
+
+  py::register_exception<qasmparser::Cancelled>(m, "CompileCancelled", PyExc_RuntimeError);
+
+  py::class_<qasmparser::CancellationToken>(m, "CancellationToken", "Cooperative cancellation of compiles, shared "
+                                                                    "between all calls it is passed to.")
+    .def(py::init<>())
+    .def("cancel", &qasmparser::CancellationToken::cancel, "Cancel all compiles holding this token.")
+    .def_property_readonly("cancelled", &qasmparser::CancellationToken::cancelled);
+
+  m.def("set_threads", &qasmparser::configureThreadPool, "Resize the persistent worker pool shared by all calls.\n"
+                                                         "@param threads: Number of threads, 0 for all cores.\n"
+                                                         "@param pin_cores: Pin worker threads to cores, "
+                                                         "otherwise release threads pinned before.",
+        py::arg("threads") = 0,  // Number of worker threads
+        py::kw_only(),
+        py::arg("pin_cores") = false,  // Pin worker threads to cores
+        py::call_guard<py::gil_scoped_release>());
+  m.def("get_threads", []() { return qasmparser::threadPool()->size(); },
+        "Number of threads of the persistent worker pool.");
+
+  m.def("enable_hardware_counters", &qasmparser::enableHardwareCounters,
+        "Count cycles, instructions, cache misses and branch misses per phase through perf_event_open, reported in "
+        "the statistics of `stats=True`.\n"
+        "@param enable: True to count from now on, false to stop counting.\n"
+        "@return: True if counting is enabled, false if disabled or refused by the kernel.",
+        py::arg("enable") = true);  // Enable or disable counting
+
+  m.def("parse_circuit",
+        [](const std::string &inFilename,
+           int version,
+           bool useOpenMP,
+           bool parameterize,
+           const std::optional<std::string> &outFilename,
+           const std::optional<double> &multiplier,
+           qasmparser::CoefficientInputs coefficientInputs,
+           const std::optional<std::size_t> &threads,
+           const std::optional<qasmparser::Backend> &backend,
+           const std::optional<qasmparser::CancellationToken> &cancel,
+           const std::optional<double> &timeout,
+           bool stats,
+           const std::optional<std::string> &traceFile) {
+          std::string qasm;
+          std::optional<qasmparser::CompileStats> compileStats;
+          {
+            py::gil_scoped_release release;
+            const qasmparser::ThreadLimit limit(threads.value_or(0));
+            if (stats)
+              compileStats.emplace();
+            std::optional<qasmparser::TraceSession> trace;
+            if (traceFile)
+              trace.emplace();
+            qasm = qasmparser::parseCircuit(inFilename, version, backendOf(useOpenMP, backend), parameterize,
+                                            outFilename, multiplier, coefficientInputs, tokenOf(cancel, timeout),
+                                            compileStats ? &compileStats.value() : nullptr);
+            if (trace)
+              trace->write(traceFile.value());
+          }
+          return withStats(qasm, compileStats);
+        },
+        "Parse an ansatz into the corresponding OpenQASM representation, "
+        "parallel execution enabled.\n"
+        "@param input_fn: Path to the input file to parse.\n"
+        "@param version: OpenQASM version to use, default 3.\n"
+        "@param use_omp: Use OpenMP parallelism, default execution policy "
+        "parallelism.\n"
+        "@param parameterize: Set true to parameterize the circuit.\n"
+        "@param output_fn: Path to (non-)existing file to store the OpenQASM"
+        "representation file. (optional)\n"
+        "@param multiplier: Floating value to be multiplied to each "
+        "operator. (optional)\n"
+        "@param coefficient_inputs: Declare coefficients as runtime inputs "
+        "`coef<n>`, v3 only, default OFF.\n"
+        "@param threads: Use at most this many threads of the persistent worker pool for this call. (optional)\n"
+        "@param backend: Parallel framework, overrides use_omp; AUTO chooses by amount of work. (optional)\n"
+        "@param cancel: Token to cancel the compile from another thread, raises CompileCancelled. (optional)\n"
+        "@param timeout: Time budget in seconds, raises CompileCancelled once exceeded. (optional)\n"
+        "@param stats: Also return a dictionary of phase timings, sizes and gate counts, default false.\n"
+        "@param trace_file: Path to write a Chrome trace of the per-thread phases and chunks to. (optional)\n"
+        "@return: OpenQASM representation, or a tuple of it and its statistics if stats is set.",
         py::arg("input_fn"),  // Input file name
         py::kw_only(),
         py::arg("version") = 3,  // OpenQASM version (default v3); Parameterization requires v3!
         py::arg("use_omp") = false,   // Specify to use OpenMP parallelism
         py::arg("parameterize") = true,  // Indicate parameterized ansatz
         py::arg_v("output_fn", std::nullopt, "None"),  // Optional output file name
-        py::arg_v("multiplier", std::nullopt, "None"));  // Optional multiplier
+        py::arg_v("multiplier", std::nullopt, "None"),  // Optional multiplier
+        py::arg("coefficient_inputs") = qasmparser::CoefficientInputs::Off,  // Runtime coefficient inputs
+        py::arg_v("threads", std::nullopt, "None"),  // Optional limit of worker threads for this call
+        py::arg_v("backend", std::nullopt, "None"),  // Optional parallel framework
+        py::arg_v("cancel", std::nullopt, "None"),  // Optional cancellation token
+        py::arg_v("timeout", std::nullopt, "None"),  // Optional time budget in seconds
+        py::arg("stats") = false,  // Return statistics with the circuit
+        py::arg_v("trace_file", std::nullopt, "None"));  // Optional Chrome trace output file
+
+  m.def("parse_circuit_async",
+        [](const std::string &inFilename,
+           int version,
+           bool useOpenMP,
+           bool parameterize,
+           const std::optional<std::string> &outFilename,
+           const std::optional<double> &multiplier,
+           qasmparser::CoefficientInputs coefficientInputs,
+           const std::optional<std::size_t> &threads,
+           const std::optional<qasmparser::Backend> &backend,
+           const std::optional<qasmparser::CancellationToken> &cancel,
+           const std::optional<double> &timeout) {
+          const auto resolved = onWorker(backendOf(useOpenMP, backend));
+          const auto token = tokenOf(cancel, timeout);
+          return submitAsync([=]() {
+            const qasmparser::ThreadLimit limit(threads.value_or(0));
+            return qasmparser::parseCircuit(inFilename, version, resolved, parameterize, outFilename, multiplier,
+                                            coefficientInputs, token);
+          }, token);
+        },
+        "Parse an ansatz into the corresponding OpenQASM representation on the library's worker threads. Must be "
+        "called from a running asyncio event loop; takes the same arguments as parse_circuit. Cancelling the future "
+        "cancels the compile. The compile runs on a worker thread of the pool, so its parallel loops run as tasks of "
+        "the pool: OPENMP, use_omp and AUTO use the execution policies, concurrent compiles never start OpenMP teams "
+        "of their own.\n"
+        "@return: asyncio future of the OpenQASM representation.",
+        py::arg("input_fn"),  // Input file name
+        py::kw_only(),
+        py::arg("version") = 3,  // OpenQASM version (default v3); Parameterization requires v3!
+        py::arg("use_omp") = false,   // Specify to use OpenMP parallelism
+        py::arg("parameterize") = true,  // Indicate parameterized ansatz
+        py::arg_v("output_fn", std::nullopt, "None"),  // Optional output file name
+        py::arg_v("multiplier", std::nullopt, "None"),  // Optional multiplier
+        py::arg("coefficient_inputs") = qasmparser::CoefficientInputs::Off,  // Runtime coefficient inputs
+        py::arg_v("threads", std::nullopt, "None"),  // Optional limit of worker threads for this call
+        py::arg_v("backend", std::nullopt, "None"),  // Optional parallel framework
+        py::arg_v("cancel", std::nullopt, "None"),  // Optional cancellation token
+        py::arg_v("timeout", std::nullopt, "None"));  // Optional time budget in seconds
+
+  m.def("parse_circuits",
+        [](const std::vector<std::string> &inFilenames,
+           int version,
+           bool useOpenMP,
+           bool parameterize,
+           const std::optional<std::vector<std::optional<std::string> > > &outFilenames,
+           const std::optional<double> &multiplier,
+           qasmparser::CoefficientInputs coefficientInputs,
+           const std::optional<std::size_t> &threads,
+           const std::optional<qasmparser::Backend> &backend,
+           const std::optional<qasmparser::CancellationToken> &cancel,
+           const std::optional<double> &timeout) {
+          const qasmparser::ThreadLimit limit(threads.value_or(0));
+          return qasmparser::parseCircuits(inFilenames, version, backendOf(useOpenMP, backend), parameterize,
+                                           outFilenames.value_or(std::vector<std::optional<std::string> >()),
+                                           multiplier, coefficientInputs, tokenOf(cancel, timeout));
+        },
+        "Parse many ansaetze into their OpenQASM representations in parallel on one shared set of worker threads.\n"
+        "@param input_fns: Paths to the input files to parse.\n"
+        "@param version: OpenQASM version to use, default 3.\n"
+        "@param use_omp: Use OpenMP parallelism, default execution policy parallelism.\n"
+        "@param parameterize: Set true to parameterize the circuits.\n"
+        "@param output_fns: One output path or None per input file. (optional)\n"
+        "@param multiplier: Floating value to be multiplied to each operator. (optional)\n"
+        "@param coefficient_inputs: Declare coefficients as runtime inputs `coef<n>`, v3 only, default OFF.\n"
+        "@param threads: Use at most this many threads of the persistent worker pool for this call. (optional)\n"
+        "@param backend: Parallel framework, overrides use_omp; AUTO chooses by amount of work. (optional)\n"
+        "@param cancel: Token to cancel the batch from another thread, raises CompileCancelled. (optional)\n"
+        "@param timeout: Time budget in seconds for the whole batch, raises CompileCancelled. (optional)\n"
+        "@return: OpenQASM representations in order of the input files.",
+        py::arg("input_fns"),  // Input file names
+        py::kw_only(),
+        py::arg("version") = 3,  // OpenQASM version (default v3); Parameterization requires v3!
+        py::arg("use_omp") = false,   // Specify to use OpenMP parallelism
+        py::arg("parameterize") = true,  // Indicate parameterized ansatz
+        py::arg_v("output_fns", std::nullopt, "None"),  // Optional output file names
+        py::arg_v("multiplier", std::nullopt, "None"),  // Optional multiplier
+        py::arg("coefficient_inputs") = qasmparser::CoefficientInputs::Off,  // Runtime coefficient inputs
+        py::arg_v("threads", std::nullopt, "None"),  // Optional limit of worker threads for this call
+        py::arg_v("backend", std::nullopt, "None"),  // Optional parallel framework
+        py::arg_v("cancel", std::nullopt, "None"),  // Optional cancellation token
+        py::arg_v("timeout", std::nullopt, "None"),  // Optional time budget in seconds
+        py::call_guard<py::gil_scoped_release>());
+
+  py::class_<qasmparser::CircuitStream>(m, "CircuitStream", "Iterator over ordered chunks of an OpenQASM "
+                                                           "representation, emitted ahead by background threads.")
+    .def("__iter__", [](qasmparser::CircuitStream &stream) -> qasmparser::CircuitStream & { return stream; })
+    .def("__next__", [](qasmparser::CircuitStream &stream) {
+           std::optional<std::string> chunk;
+           {
+             py::gil_scoped_release release;
+             chunk = stream.next();
+           }
+           if (!chunk)
+             throw py::stop_iteration();
+           return py::str(chunk.value());
+         })
+    .def("close", &qasmparser::CircuitStream::close, "Stop the background emission early, the iterator ends.",
+         py::call_guard<py::gil_scoped_release>());
+
+  m.def("iter_circuit",
+        [](const std::string &inFilename,
+           int version,
+           bool useOpenMP,
+           bool parameterize,
+           const std::optional<double> &multiplier,
+           qasmparser::CoefficientInputs coefficientInputs,
+           std::size_t lookAhead,
+           const std::optional<qasmparser::Backend> &backend,
+           const std::optional<qasmparser::CancellationToken> &cancel,
+           const std::optional<double> &timeout) {
+          return qasmparser::streamCircuit(inFilename, version, backendOf(useOpenMP, backend), parameterize,
+                                           multiplier, coefficientInputs, lookAhead, tokenOf(cancel, timeout));
+        },
+        "Parse an ansatz and iterate over its OpenQASM representation in ordered chunks: the header with the input "
+        "declarations, then the operators in windows. Background threads emit at most look_ahead chunks ahead of the "
+        "consumer, so memory stays bounded regardless of the circuit size.\n"
+        "@param input_fn: Path to the input file to parse.\n"
+        "@param version: OpenQASM version to use, default 3.\n"
+        "@param use_omp: Use OpenMP parallelism, default execution policy parallelism.\n"
+        "@param parameterize: Set true to parameterize the circuit.\n"
+        "@param multiplier: Floating value to be multiplied to each operator. (optional)\n"
+        "@param coefficient_inputs: Declare coefficients as runtime inputs `coef<n>`, v3 only, default OFF.\n"
+        "@param look_ahead: Maximal number of chunks emitted ahead of the consumer, default 2.\n"
+        "@param backend: Parallel framework, overrides use_omp. (optional)\n"
+        "@param cancel: Token to cancel the stream from another thread, raises CompileCancelled. (optional)\n"
+        "@param timeout: Time budget in seconds for the whole stream, raises CompileCancelled. (optional)\n"
+        "@return: Iterator over the chunks of the OpenQASM representation.",
+        py::arg("input_fn"),  // Input file name
+        py::kw_only(),
+        py::arg("version") = 3,  // OpenQASM version (default v3); Parameterization requires v3!
+        py::arg("use_omp") = false,   // Specify to use OpenMP parallelism
+        py::arg("parameterize") = true,  // Indicate parameterized ansatz
+        py::arg_v("multiplier", std::nullopt, "None"),  // Optional multiplier
+        py::arg("coefficient_inputs") = qasmparser::CoefficientInputs::Off,  // Runtime coefficient inputs
+        py::arg("look_ahead") = 2,  // Chunks emitted ahead of the consumer
+        py::arg_v("backend", std::nullopt, "None"),  // Optional parallel framework
+        py::arg_v("cancel", std::nullopt, "None"),  // Optional cancellation token
+        py::arg_v("timeout", std::nullopt, "None"),  // Optional time budget in seconds
+        py::call_guard<py::gil_scoped_release>());
+
+  py::class_<qasmparser::CircuitTemplate>(m, "CircuitTemplate", "Concrete circuit with recorded angle slots.")
+    .def("bind", &qasmparser::CircuitTemplate::bind, "Write the concrete circuit for the given parameter values in a "
+                                                     "single pass.\n"
+                                                     "@param values: One value per parameter, ordered as the "
+                                                     "`parameters` property.",
+        py::arg("values"),
+        py::call_guard<py::gil_scoped_release>())
+    .def("bind_batch",
+         [](const qasmparser::CircuitTemplate &tmpl,
+            const py::array_t<double, py::array::c_style | py::array::forcecast> &values,
+            bool useOpenMP,
+            const std::optional<qasmparser::Backend> &backend) {
+           const auto rows = parameterRows(values);
+           py::gil_scoped_release release;
+           return tmpl.bindBatch(rows, backendOf(useOpenMP, backend));
+         },
+         "Write the concrete circuits for all rows of a parameter matrix in parallel.\n"
+         "@param values: Two-dimensional parameter matrix, one row per circuit.\n"
+         "@param use_omp: Use OpenMP parallelism, default execution policy parallelism.\n"
+         "@param backend: Parallel framework, overrides use_omp. (optional)",
+        py::arg("values"),
+        py::kw_only(),
+        py::arg("use_omp") = false,
+        py::arg_v("backend", std::nullopt, "None"))
+    .def("bind_batch_to_files",
+         [](const qasmparser::CircuitTemplate &tmpl,
+            const py::array_t<double, py::array::c_style | py::array::forcecast> &values,
+            const std::string &directory,
+            bool useOpenMP,
+            std::size_t shardSize,
+            const std::optional<qasmparser::Backend> &backend) {
+           const auto rows = parameterRows(values);
+           py::gil_scoped_release release;
+           return tmpl.bindBatchToFiles(rows, directory, backendOf(useOpenMP, backend), shardSize);
+         },
+         "Write the concrete circuits for all rows of a parameter matrix in parallel into a sharded directory.\n"
+         "@param values: Two-dimensional parameter matrix, one row per circuit.\n"
+         "@param directory: Output directory, created if missing.\n"
+         "@param use_omp: Use OpenMP parallelism, default execution policy parallelism.\n"
+         "@param shard_size: Circuits per shard subdirectory, 0 for none.\n"
+         "@param backend: Parallel framework, overrides use_omp. (optional)\n"
+         "@return: Paths of the written files.",
+        py::arg("values"),
+        py::arg("directory"),
+        py::kw_only(),
+        py::arg("use_omp") = false,
+        py::arg("shard_size") = 1000,
+        py::arg_v("backend", std::nullopt, "None"))
+    .def_property_readonly("parameters", &qasmparser::CircuitTemplate::parameters);
+
+  // Shared holder, so streams keep the session alive while they emit
+  py::class_<qasmparser::Parser, std::shared_ptr<qasmparser::Parser> >(m, "CompiledHamiltonian",
+                                                                       "Ansatz read and converted once, emitted "
+                                                                       "repeatedly into OpenQASM with different "
+                                                                       "settings.")
+    .def(py::init([](const std::string &inFilename,
+                     bool useOpenMP,
+                     const std::optional<qasmparser::Backend> &backend,
+                     const std::optional<qasmparser::CancellationToken> &cancel,
+                     const std::optional<double> &timeout) {
+           // pybind11 registers the new instance after the factory returns, which needs the GIL
+           py::gil_scoped_release release;
+           return std::make_shared<qasmparser::Parser>(inFilename, backendOf(useOpenMP, backend),
+                                                       tokenOf(cancel, timeout));
+         }),
+         "Read and convert an ansatz.\n"
+         "@param input_fn: Path to the input file to parse.\n"
+         "@param use_omp: Use OpenMP parallelism, default execution policy parallelism.\n"
+         "@param backend: Parallel framework, overrides use_omp. (optional)\n"
+         "@param cancel: Token to cancel reading from another thread, raises CompileCancelled. (optional)\n"
+         "@param timeout: Time budget in seconds, raises CompileCancelled once exceeded. (optional)",
+        py::arg("input_fn"),  // Input file name
+        py::kw_only(),
+        py::arg("use_omp") = false,  // Specify to use OpenMP parallelism
+        py::arg_v("backend", std::nullopt, "None"),  // Optional parallel framework
+        py::arg_v("cancel", std::nullopt, "None"),  // Optional cancellation token
+        py::arg_v("timeout", std::nullopt, "None"))  // Optional time budget in seconds
+    .def("emit",
+         [](const qasmparser::Parser &p,
+            int version,
+            bool useOpenMP,
+            bool parameterize,
+            const std::optional<std::string> &outFilename,
+            const std::optional<double> &multiplier,
+            qasmparser::CoefficientInputs coefficientInputs,
+            const std::optional<qasmparser::Backend> &backend,
+            const std::optional<qasmparser::CancellationToken> &cancel,
+            const std::optional<double> &timeout,
+            bool stats) {
+           std::string qasm;
+           std::optional<qasmparser::CompileStats> compileStats;
+           {
+             py::gil_scoped_release release;
+             if (stats)
+               compileStats.emplace();
+             qasm = p.emit(version, backendOf(useOpenMP, backend), parameterize, outFilename, multiplier,
+                           coefficientInputs, tokenOf(cancel, timeout), compileStats ? &compileStats.value() : nullptr);
+           }
+           return withStats(qasm, compileStats);
+         },
+         "Emit the OpenQASM representation without re-reading the input file.\n"
+         "@param version: OpenQASM version to use, default 3.\n"
+         "@param use_omp: Use OpenMP parallelism, default execution policy "
+         "parallelism.\n"
+         "@param parameterize: Set true to parameterize the circuit.\n"
+         "@param output_fn: Path to (non-)existing file to store the OpenQASM"
+         "representation file. (optional)\n"
+         "@param multiplier: Floating value to be multiplied to each "
+         "operator. (optional)\n"
+         "@param coefficient_inputs: Declare coefficients as runtime inputs "
+         "`coef<n>`, v3 only, default OFF.\n"
+         "@param backend: Parallel framework, overrides use_omp. (optional)\n"
+         "@param cancel: Token to cancel the emission from another thread, raises CompileCancelled. (optional)\n"
+         "@param timeout: Time budget in seconds, raises CompileCancelled once exceeded. (optional)\n"
+         "@param stats: Also return a dictionary of phase timings, sizes and gate counts, default false.\n"
+         "@return: OpenQASM representation, or a tuple of it and its statistics if stats is set.",
+        py::kw_only(),
+        py::arg("version") = 3,  // OpenQASM version (default v3); Parameterization requires v3!
+        py::arg("use_omp") = false,   // Specify to use OpenMP parallelism
+        py::arg("parameterize") = true,  // Indicate parameterized ansatz
+        py::arg_v("output_fn", std::nullopt, "None"),  // Optional output file name
+        py::arg_v("multiplier", std::nullopt, "None"),  // Optional multiplier
+        py::arg("coefficient_inputs") = qasmparser::CoefficientInputs::Off,  // Runtime coefficient inputs
+        py::arg_v("backend", std::nullopt, "None"),  // Optional parallel framework
+        py::arg_v("cancel", std::nullopt, "None"),  // Optional cancellation token
+        py::arg_v("timeout", std::nullopt, "None"),  // Optional time budget in seconds
+        py::arg("stats") = false)  // Return statistics with the circuit
+    .def("iter_emit",
+         [](const std::shared_ptr<qasmparser::Parser> &p,
+            int version,
+            bool useOpenMP,
+            bool parameterize,
+            const std::optional<double> &multiplier,
+            qasmparser::CoefficientInputs coefficientInputs,
+            std::size_t lookAhead,
+            const std::optional<qasmparser::Backend> &backend,
+            const std::optional<qasmparser::CancellationToken> &cancel,
+            const std::optional<double> &timeout) {
+           return qasmparser::CircuitStream(p, version, backendOf(useOpenMP, backend), parameterize, multiplier,
+                                            coefficientInputs, lookAhead, tokenOf(cancel, timeout));
+         },
+         "Iterate over the OpenQASM representation in ordered chunks, see iter_circuit.\n"
+         "@param version: OpenQASM version to use, default 3.\n"
+         "@param use_omp: Use OpenMP parallelism, default execution policy parallelism.\n"
+         "@param parameterize: Set true to parameterize the circuit.\n"
+         "@param multiplier: Floating value to be multiplied to each operator. (optional)\n"
+         "@param coefficient_inputs: Declare coefficients as runtime inputs `coef<n>`, v3 only, default OFF.\n"
+         "@param look_ahead: Maximal number of chunks emitted ahead of the consumer, default 2.\n"
+         "@param backend: Parallel framework, overrides use_omp. (optional)\n"
+         "@param cancel: Token to cancel the stream from another thread, raises CompileCancelled. (optional)\n"
+         "@param timeout: Time budget in seconds for the whole stream, raises CompileCancelled. (optional)",
+        py::kw_only(),
+        py::arg("version") = 3,  // OpenQASM version (default v3); Parameterization requires v3!
+        py::arg("use_omp") = false,   // Specify to use OpenMP parallelism
+        py::arg("parameterize") = true,  // Indicate parameterized ansatz
+        py::arg_v("multiplier", std::nullopt, "None"),  // Optional multiplier
+        py::arg("coefficient_inputs") = qasmparser::CoefficientInputs::Off,  // Runtime coefficient inputs
+        py::arg("look_ahead") = 2,  // Chunks emitted ahead of the consumer
+        py::arg_v("backend", std::nullopt, "None"),  // Optional parallel framework
+        py::arg_v("cancel", std::nullopt, "None"),  // Optional cancellation token
+        py::arg_v("timeout", std::nullopt, "None"))  // Optional time budget in seconds
+    .def("coefficient_inputs",
+         [](const qasmparser::Parser &p, qasmparser::CoefficientInputs mode) {
+           py::dict inputs;
+           for (const auto &[name, value] : p.coefficientInputValues(mode))
+             inputs[py::str(name)] = value;
+           return inputs;
+         },
+         "Values of the runtime coefficient inputs declared by `emit` for the given mode.\n"
+         "@param mode: PER_TERM or PER_VALUE.\n"
+         "@return: Dictionary mapping input names to coefficient values.",
+        py::arg("mode"))
+    .def("compile_template",
+         [](const qasmparser::Parser &p,
+            int version,
+            bool useOpenMP,
+            const std::optional<double> &multiplier,
+            const std::optional<qasmparser::Backend> &backend) {
+           return p.compileTemplate(version, backendOf(useOpenMP, backend), multiplier);
+         },
+         "Emit the non-parameterized circuit once with empty angle slots, to be bound to parameter values later.\n"
+         "@param version: OpenQASM version to use, default 3.\n"
+         "@param use_omp: Use OpenMP parallelism, default execution policy parallelism.\n"
+         "@param multiplier: Floating value to be multiplied to each operator. (optional)\n"
+         "@param backend: Parallel framework, overrides use_omp. (optional)",
+        py::kw_only(),
+        py::arg("version") = 3,  // OpenQASM version (default v3)
+        py::arg("use_omp") = false,   // Specify to use OpenMP parallelism
+        py::arg_v("multiplier", std::nullopt, "None"),  // Optional multiplier
+        py::arg_v("backend", std::nullopt, "None"),  // Optional parallel framework
+        py::call_guard<py::gil_scoped_release>())
+    .def("schedule", &qasmparser::Parser::schedule, "Backend and chunks the emission runs with; parallel emission "
+                                                    "cuts chunks of about equal cost, its grain size is 0.\n"
+                                                    "@param backend: Requested parallel framework, default AUTO.",
+        py::arg("backend") = qasmparser::Backend::Auto)
+    .def_property_readonly("conversion_schedule", &qasmparser::Parser::conversionSchedule,
+                           "Schedule the conversion of the operators ran with on construction.")
+    .def_property_readonly("num_qubits", &qasmparser::Parser::qubitCount)
+    .def_property_readonly("parameters", &qasmparser::Parser::parameters)
+    .def("__len__", &qasmparser::Parser::operatorCount);
 }
@@ -0,0 +1,92 @@
+//
+// Cooperative cancellation of long compiles.
+//
+
+#ifndef QASM_PARSER_CANCELLATION_H
+#define QASM_PARSER_CANCELLATION_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+
+
+namespace qasmparser {
+    /**
+     * Thrown by a compile whose cancellation token was cancelled or whose deadline passed.
+     */
+    class Cancelled : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    /**
+     * Cooperative cancellation token with an optional deadline. Copies share the cancellation flag, so a token handed
+     * to a compile can be cancelled from any other thread. The read, convert and emit loops check the token
+     * periodically, skip their remaining work once it expired and throw `Cancelled` after the loop.
+     */
+    class CancellationToken {
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        std::shared_ptr<std::atomic<bool> > flag;            // Shared between all copies of the token
+        std::shared_ptr<const CancellationToken> parent;     // Token this one was derived from by `child`, if any
+        std::optional<Clock::time_point> deadline;           // Time after which the token counts as expired
+
+    public:
+        CancellationToken() : flag(std::make_shared<std::atomic<bool> >(false)) {}
+
+        /**
+         * Cancel all compiles holding this token or a copy of it.
+         */
+        void cancel() const { flag->store(true, std::memory_order_relaxed); }
+
+        /**
+         * @return True if the token or the token it was derived from was cancelled, the deadline is not considered
+         */
+        bool cancelled() const { return flag->load(std::memory_order_relaxed) || (parent && parent->cancelled()); }
+
+        /**
+         * @return True if the token was cancelled or its deadline passed
+         */
+        bool expired() const { return cancelled() || (deadline && Clock::now() > deadline.value()); }
+
+        /**
+         * Copy of the token sharing its cancellation flag, expiring at the latest the given time from now.
+         * @param seconds Time budget in seconds
+         * @return Token with deadline
+         */
+        CancellationToken withTimeout(const double seconds) const {
+            CancellationToken token = *this;
+            const auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(seconds));
+            token.deadline = deadline ? std::min(deadline.value(), end) : end;
+            return token;
+        }
+
+        /**
+         * Token cancelled together with this one and its copies, with the same deadline, that can also be cancelled
+         * on its own without affecting this one.
+         * @return Derived token
+         */
+        CancellationToken child() const {
+            CancellationToken token;
+            token.parent = std::make_shared<const CancellationToken>(*this);
+            token.deadline = deadline;
+            return token;
+        }
+
+        /**
+         * Throw `Cancelled` if the token expired.
+         */
+        void check() const {
+            if (cancelled())
+                throw Cancelled("Compile cancelled!");
+            if (deadline && Clock::now() > deadline.value())
+                throw Cancelled("Compile deadline exceeded!");
+        }
+    };
+}
+
+#endif //QASM_PARSER_CANCELLATION_H
@@ -0,0 +1,60 @@
+//
+// Seeded synthetic Hamiltonians in the input format of the parser.
+//
+
+#ifndef QASM_PARSER_GENERATOR_H
+#define QASM_PARSER_GENERATOR_H
+
+#include <cstdint>
+#include <string>
+
+#include "thread_pool.h"
+
+
+namespace qasmparser {
+    /**
+     * Structure of the generated Pauli strings.
+     */
+    enum class HamiltonianFamily {
+        RandomSparse,                                        // Random qubits, weight uniform in [minWeight, maxWeight]
+        FixedWeight,                                         // Random qubits, weight exactly minWeight
+        JordanWigner,                                        // X or Y at both ends of a Z string of random length
+        Lattice                                              // XX, YY and ZZ on nearest neighbours of a square lattice
+    };
+
+    /**
+     * Shape of a synthetic Hamiltonian. The same options and seed always produce the same file, independent of the
+     * number of threads and the backend it is generated with.
+     */
+    struct GeneratorOptions {
+        HamiltonianFamily family = HamiltonianFamily::RandomSparse;
+        unsigned long qubits = 16;                           // Length of every Pauli string
+        std::size_t terms = 1000;                            // Number of lines
+        std::size_t minWeight = 2;                           // Smallest number of active qubits of a term
+        std::size_t maxWeight = 4;                           // Largest number of active qubits of a term
+        std::size_t parameters = 0;                          // Distinct shared parameters, 0: every term independent
+        unsigned long latticeWidth = 0;                      // Sites per lattice row, 0: one-dimensional chain
+        std::uint64_t seed = 1;
+    };
+
+    /**
+     * Generate a synthetic Hamiltonian as text. Terms are generated in blocks with a seed of their own, in parallel.
+     * @param options Family, size and seed of the Hamiltonian, throws invalid_argument if inconsistent
+     * @param backend Parallel framework, Auto to choose by the amount of work
+     * @return Hamiltonian in the input format of the parser, one term per line
+     */
+    std::string generateHamiltonian(const GeneratorOptions &options, Backend backend = Backend::ExecutionPolicy);
+
+    /**
+     * Generate a synthetic Hamiltonian into a file. Blocks are generated in parallel and written in order a window at
+     * a time, so memory stays bounded for files much larger than the main memory.
+     * @param options Family, size and seed of the Hamiltonian, throws invalid_argument if inconsistent
+     * @param outFilename Path of the file to write, throws runtime_error if it cannot be written
+     * @param backend Parallel framework, Auto to choose by the amount of work
+     */
+    void writeHamiltonian(const GeneratorOptions &options,
+                          const std::string &outFilename,
+                          Backend backend = Backend::ExecutionPolicy);
+}
+
+#endif //QASM_PARSER_GENERATOR_H
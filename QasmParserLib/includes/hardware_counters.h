@@ -0,0 +1,75 @@
+//
+// Hardware performance counters per phase of a compile, read through Linux perf_event_open.
+//
+
+#ifndef QASM_PARSER_HARDWARE_COUNTERS_H
+#define QASM_PARSER_HARDWARE_COUNTERS_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+
+namespace qasmparser {
+    /**
+     * Hardware events of a phase, summed over all threads taking part. Counts are scaled up if the kernel multiplexed
+     * the counters. All fields stay 0 and `valid` false unless counters are enabled and available.
+     */
+    struct HardwareCounters {
+        bool valid = false;                                  // Counters were enabled and readable during the phase
+        std::uint64_t cycles = 0;                            // CPU cycles in user space
+        std::uint64_t instructions = 0;                      // Retired instructions in user space
+        std::uint64_t cacheMisses = 0;                       // Last-level cache misses
+        std::uint64_t branchMisses = 0;                      // Mispredicted branches
+    };
+
+    namespace detail {
+        extern std::atomic<bool> countersEnabled;
+
+        /**
+         * Open the counters of the calling thread, unless it already has them.
+         */
+        void attachCounters();
+    }
+
+    /**
+     * Enable or disable counting. Counters are opened lazily on every thread working on a phase, in user space only,
+     * so they need no privileges beyond the default `perf_event_paranoid` level of 2. If the kernel refuses them,
+     * e.g. in containers without perf support, counting stays disabled and phases report invalid counters.
+     * @param enable True to count from now on
+     * @return True if counting is enabled, false if disabled or not available
+     */
+    bool enableHardwareCounters(bool enable);
+
+    /**
+     * @return True if counting is enabled
+     */
+    inline bool hardwareCountersEnabled() { return detail::countersEnabled.load(std::memory_order_relaxed); }
+
+    /**
+     * Make sure the calling thread is counted. Costs a single relaxed load while counting is disabled.
+     */
+    inline void countThread() {
+        if (hardwareCountersEnabled())
+            detail::attachCounters();
+    }
+
+    /**
+     * Hardware events from construction until `finish`, over all counted threads. Concurrent calls in other threads
+     * count towards the phase as well.
+     */
+    class CounterPhase {
+    private:
+        HardwareCounters start;
+
+    public:
+        CounterPhase();
+
+        /**
+         * @return Events since construction
+         */
+        HardwareCounters finish() const;
+    };
+}
+
+#endif //QASM_PARSER_HARDWARE_COUNTERS_H
@@ -0,0 +1,69 @@
+//
+// Allocation and peak-memory accounting per phase of a compile.
+//
+
+#ifndef QASM_PARSER_MEMORY_USAGE_H
+#define QASM_PARSER_MEMORY_USAGE_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace qasmparser {
+    /**
+     * Heap usage of a phase. Only counted in builds with QASMPARSER_MEMORY_ACCOUNTING, which replace the global
+     * operator new and delete of the process; all fields stay 0 otherwise.
+     */
+    struct MemoryUsage {
+        std::size_t allocations = 0;                         // Number of allocations
+        std::size_t bytes = 0;                               // Bytes allocated, freed ones included
+        std::size_t peakBytes = 0;                           // Highest live heap bytes during the phase above the start
+        std::ptrdiff_t retainedBytes = 0;                    // Live bytes at the end minus at the start of the phase
+    };
+
+    /**
+     * @return True if the library counts allocations, i.e. was built with QASMPARSER_MEMORY_ACCOUNTING
+     */
+    bool memoryAccounting();
+
+    /**
+     * Heap usage from construction until `finish`. Counters are process-wide, allocations of concurrent calls in
+     * other threads count towards the phase as well. Each open phase tracks its own high-water mark, so phases may nest
+     * and overlap; beyond `maxPhases` open at once the peak of the newer phases falls back to the live bytes at `finish`.
+     */
+    class MemoryPhase {
+    private:
+        std::size_t allocations;                             // Counters at the start of the phase
+        std::size_t bytes;
+        std::size_t live;
+        int slot;                                            // Index of the phase's high-water mark, -1 for none
+
+    public:
+        static constexpr int maxPhases = 64;
+
+        MemoryPhase();
+
+        ~MemoryPhase();
+
+        MemoryPhase(const MemoryPhase &) = delete;
+
+        MemoryPhase &operator=(const MemoryPhase &) = delete;
+
+        /**
+         * @return Usage since construction
+         */
+        MemoryUsage finish() const;
+    };
+
+    /**
+     * Append the usage of the phases of a compile as a JSON line to the file named by the environment variable
+     * QASMPARSER_MEMORY_REPORT. Does nothing if it is unset or the library does not count allocations.
+     * @param terms Number of operators of the compile
+     * @param phases Name and usage of each phase
+     */
+    void reportMemory(std::size_t terms, const std::vector<std::pair<const char *, MemoryUsage> > &phases);
+}
+
+#endif //QASM_PARSER_MEMORY_USAGE_H
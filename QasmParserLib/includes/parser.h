@@ -5,20 +5,156 @@
 #ifndef QASM_PARSER_PARSER_H
 #define QASM_PARSER_PARSER_H
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
-#include <map>
 #include <optional>
 
+#include "cancellation.h"
+#include "hardware_counters.h"
+#include "memory_usage.h"
+#include "thread_pool.h"
+
 
 namespace qasmparser {
+    /**
+     * Declaration of operator coefficients as runtime inputs in OpenQASM version 3. Off bakes the coefficients into the
+     * rotation angles, PerTerm declares one input per operator, PerValue one input per distinct coefficient value.
+     */
+    enum class CoefficientInputs {
+        Off,
+        PerTerm,
+        PerValue
+    };
+
+    /**
+     * Timings and sizes of a compile. Phases are timed with two clock reads each and gates are counted from the
+     * operator weights, so collecting them costs next to nothing. Utilization is the CPU time of the whole process
+     * over wall time times pool size, concurrent calls therefore count towards each other. Heap usage of the phases is
+     * only counted in builds with QASMPARSER_MEMORY_ACCOUNTING, see `MemoryUsage`, and hardware events only once
+     * enabled with `enableHardwareCounters`.
+     */
+    struct CompileStats {
+        double readSeconds = 0;                              // Reading and checking the input file
+        double convertSeconds = 0;                           // Conversion into integer representation
+        double emitSeconds = 0;                              // Emission of the operator fragments
+        double assembleSeconds = 0;                          // Concatenation of header, declarations and fragments
+        double writeSeconds = 0;                             // Writing the output file, 0 without output file
+        std::size_t bytesIn = 0;                             // Size of the input file
+        std::size_t bytesOut = 0;                            // Size of the OpenQASM representation
+        std::size_t terms = 0;                               // Number of operators
+        std::size_t parameters = 0;                          // Number of distinct parameters
+        std::size_t rzGates = 0;                             // Parameterized rotations, one per active operator
+        std::size_t cxGates = 0;                             // CNOTs of the ladders
+        std::size_t rxGates = 0;                             // Basis changes of Pauli-Y qubits
+        std::size_t ryGates = 0;                             // Basis changes of Pauli-X qubits
+        std::size_t threads = 0;                             // Size of the worker pool
+        double utilization = 0;                              // Busy share of the pool in conversion and emission
+        MemoryUsage readMemory;                              // Operator vector and string representations
+        MemoryUsage convertMemory;                           // Integer representations, freed strings deducted
+        MemoryUsage emitMemory;                              // Fragments of all operators
+        MemoryUsage assembleMemory;                          // Final OpenQASM string
+        HardwareCounters readCounters;                       // Hardware events of each phase, see `HardwareCounters`
+        HardwareCounters convertCounters;
+        HardwareCounters emitCounters;
+        HardwareCounters assembleCounters;
+    };
+
+    class Parser;
+    class CircuitStream;
+    struct PhaseAccess;
+
+    /**
+     * Concrete circuit with its rotation angles cut out. The offset of each angle is recorded together with the folded
+     * multiplier and coefficient and the parameter it depends on, so binding parameter values is a single copy of the
+     * text with the angles formatted in between.
+     */
+    class CircuitTemplate {
+    private:
+        /**
+         * Angle slot in the template text.
+         */
+        struct Slot {
+            std::size_t offset;                              // Offset of the angle in `text`
+            double angle;                                    // Folded multiplier and coefficient
+            std::size_t param;                               // Position of the parameter in `parameterIndices`
+        };
+
+        static constexpr std::size_t maxAngleLength = 32;    // Upper bound of a shortest round-trip double
+
+        std::string text;                                    // Circuit text without angles
+        std::vector<Slot> slots;                             // Angle slots in order of their offset
+        std::vector<unsigned long> parameterIndices;         // Distinct parameters in order of first occurrence
+
+        friend class Parser;
+
+        /**
+         * Check that each row of a parameter matrix holds one value per parameter. Throw error otherwise.
+         * @param values Parameter matrix, one row of values per circuit
+         */
+        void checkRows(const std::vector<std::vector<double> > &values) const;
+
+        /**
+         * @return Estimated cost of binding one row, in emitted gates of about 16 bytes each
+         */
+        std::size_t rowWork() const { return text.size() / 16 + 1; }
+
+    public:
+        /**
+         * Write the concrete circuit for the given parameter values.
+         * @param values One value per parameter, ordered as returned by `parameters`
+         * @return OpenQASM representation with numeric rotation angles
+         */
+        std::string bind(const std::vector<double> &values) const;
+
+        /**
+         * Write the concrete circuits for many parameter sets in parallel.
+         * @param values Parameter matrix, one row of values per circuit, ordered as returned by `parameters`
+         * @param backend Parallel framework, Auto to choose by the amount and distribution of work
+         * @return OpenQASM representation for each row, in order of the rows
+         */
+        std::vector<std::string> bindBatch(const std::vector<std::vector<double> > &values,
+                                           Backend backend = Backend::ExecutionPolicy) const;
+
+        /**
+         * Write the concrete circuits for many parameter sets in parallel into a sharded directory. The circuit of row
+         * `i` is written to `<directory>/shard_<i / shardSize>/circuit_<i>.qasm`, or directly into the directory if
+         * `shardSize` is zero. Missing directories are created.
+         * @param values Parameter matrix, one row of values per circuit, ordered as returned by `parameters`
+         * @param directory Output directory
+         * @param backend Parallel framework, Auto to choose by the amount and distribution of work
+         * @param shardSize Number of circuits per shard subdirectory, 0 for no subdirectories
+         * @return Paths of the written files, in order of the rows
+         */
+        std::vector<std::string> bindBatchToFiles(const std::vector<std::vector<double> > &values,
+                                                  const std::string &directory,
+                                                  Backend backend = Backend::ExecutionPolicy,
+                                                  std::size_t shardSize = 1000) const;
+
+        /**
+         * @return Distinct parameter indices in the order `bind` expects their values
+         */
+        const std::vector<unsigned long> &parameters() const { return parameterIndices; }
+    };
+
     /**
      * Implementation of a Quantum Parser Class. Holds operators, coefficients and parameters of the input file in instance
      * of subclass QuantumOperator. Implements parsing functionality to parse into OpenQASM Standard, version specified in
-     * variable.
+     * variable. An instance is a compiled session: the input file is read and converted once on construction, and the
+     * OpenQASM representation can be emitted repeatedly with different settings.
      */
     class Parser {
     private:
+        friend class CircuitStream;
+        friend struct PhaseAccess;                           // Benchmarks time the private phases one by one
+
         /**
          * Quantum operator struct holding information about operator, namely the index of occurrence in the input file,
          * gates working on which qubits, the coefficients, and the parameter. The parameter is used to indicate dependent
@@ -28,15 +164,29 @@ namespace qasmparser {
             unsigned long index;                             // Index of operator in input (for order of operators)
             std::string strRep;                              // String representation of operator
             std::vector<std::vector<unsigned long> > intOp;  // Operator integer representation stored in vector of vectors
-            float coef;                                      // Coefficient of operator
+            double coef;                                     // Coefficient of operator
             unsigned long param;                             // Parameter indicating dependencies
         };
 
-        unsigned long numberQubits;                          // Must equal length of operators in string representation
-        std::string mup = "2*";                            // Float value to multiply operations as string
+        unsigned long numberQubits = 0;                      // Must equal length of operators in string representation
+        std::size_t totalWeight = 0;                         // Sum of the Pauli weights of all operators
+        std::size_t maxWeight = 0;                           // Largest Pauli weight of an operator
+        Schedule conversion{Backend::Sequential, 0};         // Schedule the conversion ran with
         std::vector<QuantumOperator> operators;              // Vector holding all operators as Quantum Operator struct
-        bool parameterize;
         std::vector<unsigned long> parameterIndices;
+        std::size_t inputBytes = 0;                          // Size of the input file read
+        double readSeconds = 0;                              // Wall time of reading the input file
+        double convertSeconds = 0;                           // Wall time of the conversion
+        double convertCpuSeconds = 0;                        // CPU time of the process during the conversion
+        MemoryUsage readMemory;                              // Heap usage of reading
+        MemoryUsage convertMemory;                           // Heap usage of the conversion
+        HardwareCounters readCounters;                       // Hardware events of reading
+        HardwareCounters convertCounters;                    // Hardware events of the conversion
+
+        /**
+         * Empty parser without operators, filled phase by phase.
+         */
+        Parser() = default;
 
         /**
          * Parse string representation of input into shorter integer representation describing operator. Integer
@@ -47,6 +197,14 @@ namespace qasmparser {
          */
         static std::vector<std::vector<unsigned long> > parseStrInt(std::string &in);
 
+        /**
+         * @param op Operator in integer representation
+         * @return Number of qubits the operator acts on non-trivially
+         */
+        static std::size_t pauliWeight(const QuantumOperator &op) {
+            return op.intOp[0].size() + op.intOp[1].size() + op.intOp[2].size();
+        }
+
         /**
          * Check input for errors. Throw error if string representations have different lengths, the coefficient has a value
          * of zero, or the parameter has a value of less than one. Different string length correspond to different numbers
@@ -57,62 +215,382 @@ namespace qasmparser {
          * @param coef Coefficient of operator.
          * @param param Parameter of operator.
          */
-        void errorCheck(std::string &str, float &coef, unsigned long &param) const;
+        void errorCheck(std::string &str, double &coef, unsigned long &param) const;
 
         /**
-         * Print error message and line of occurrence.
-         * @param errMessage Error message to print.
+         * Throw an invalid_argument exception holding the error message and line of occurrence. The library never
+         * terminates the process, so concurrent calls of other threads are not affected by a faulty input file.
+         * @param errMessage Error message to report.
          * @param idx Line in input file of error occurrence.
          */
-        static void printError(const std::string &errMessage, unsigned long &idx);
+        [[noreturn]] static void lineError(const std::string &errMessage, unsigned long idx);
+
+        static constexpr unsigned long checkInterval = 4096; // Lines read between cancellation checks
 
         /**
          * Read lines of the input file, perform error checking, convert representation of operators and store in quantum
          * operator instances. Push all operator instances in operators member.
          * @param filename Path to the input file.
+         * @param cancel Checked every `checkInterval` lines
+         */
+        void readLines(const std::string &filename, const CancellationToken &cancel);
+
+        /**
+         * Convert the string representation of every operator into its integer representation. The string
+         * representation is released afterwards, it is not needed for emission. Pauli weights are summed up for
+         * scheduling the emission.
+         * @param backend Parallel framework, Auto to choose by the amount and distribution of work
+         * @param cancel Checked for every operator
+         */
+        void convertOperators(Backend backend, const CancellationToken &cancel);
+
+        /**
+         * OpenQASM representation of a single operator together with the position of its rotation angle.
+         */
+        struct QasmFragment {
+            std::string qasm;                                // OpenQASM representation of operator
+            std::size_t angleOffset;                         // Offset of rotation angle in `qasm`, npos if no rotation
+        };
+
+        /**
+         * Shape of the CNOT ladder of an operator. Each rung is a CNOT onto the last used qubit, together with the
+         * basis change of its control qubit. Rungs are numbered in emission order in front of the rotation, Pauli-Z
+         * down to Pauli-X and descending in qubits; behind the rotation they are mirrored.
+         */
+        struct Ladder {
+            unsigned long lastUsed;                          // Last used qubit, 1-based, 0 if no active qubits
+            bool lastX;                                      // Last used qubit is rotated into the X basis
+            bool lastY;                                      // Last used qubit is rotated into the Y basis
+            std::size_t xCount;                              // Number of Pauli-X rungs
+            std::size_t yCount;                              // Number of Pauli-Y rungs
+            std::size_t zCount;                              // Number of Pauli-Z rungs
+        };
+
+        static constexpr std::size_t splitWeight = 4096;     // Ladders of at least this many rungs are split
+        static constexpr std::size_t splitRungs = 1024;      // Rungs per part of a split ladder
+
+        /**
+         * @param qop Operator in integer representation
+         * @return Shape of the CNOT ladder of the operator
          */
-        void readLines(const std::string &filename);
+        static Ladder ladder(const QuantumOperator &qop);
+
+        /**
+         * Parse a range of rungs of an operator's CNOT ladder into OpenQASM representation.
+         * @param qop Operator in integer representation
+         * @param l Shape of the operator's ladder
+         * @param before True: Rungs in front of the rotation; False: Mirrored rungs behind the rotation
+         * @param from First rung of the range, in emission order
+         * @param to Rung past the range, in emission order
+         * @param qasmOp String the representation is appended to
+         */
+        static void parseLadderToQasm(const QuantumOperator &qop, const Ladder &l, bool before,
+                                      std::size_t from, std::size_t to, std::string &qasmOp);
 
         /**
          * Parse QuantumOperator instance operator into OpenQASM representation. Pauli-X and -Y operations are performed
-         * using rotations along the corresponding basis.
+         * using rotations along the corresponding basis. Gates are appended in output order, no reordering of the
+         * string is needed. Ladders of at least `splitWeight` rungs are emitted in parts by nested parallel tasks.
          * @param qubitIdx QuantumOperator instance holding index, parameter, coefficient, and integer representation
-         * @return String representation of operator in QASM version 2
+         * @param angle Text of the rotation angle in Z basis, may be empty to leave a slot
+         * @param qasmOp String the representation of operator in QASM version 2 is appended to
+         * @param backend Framework the nested tasks of a split ladder run on, Sequential to not split
+         * @return Offset of the rotation angle in `qasmOp`, std::string::npos if operator has no active qubits
          */
-        std::string parseOpToQasm(QuantumOperator &qubitIdx);
+        static std::size_t parseOpToQasm(const QuantumOperator &qubitIdx, const std::string &angle, std::string &qasmOp,
+                                         Backend backend = Backend::Sequential);
+
+        /**
+         * Parse a range of operators into OpenQASM fragments in parallel.
+         * @param backend Parallel framework, Auto to choose by the amount and distribution of work
+         * @param angle Returns the text of the rotation angle of an operator
+         * @param first Index of the first operator of the range
+         * @param last Index past the last operator of the range
+         * @param cancel Checked for every operator
+         * @return Fragments ordered as the operators of the range
+         */
+        std::vector<QasmFragment> parseOperators(Backend backend,
+                                                 const std::function<std::string(const QuantumOperator &)> &angle,
+                                                 std::size_t first, std::size_t last,
+                                                 const CancellationToken &cancel = CancellationToken()) const;
+
+        /**
+         * Append the fragments to the representation in order, allocating the final size once.
+         * @param qasm Representation the fragments are appended to
+         * @param fragments Fragments ordered as the operators
+         */
+        static void assemble(std::string &qasm, const std::vector<QasmFragment> &fragments);
+
+        /**
+         * @return Timings of reading and conversion, sizes of the input and gate counts of the circuit
+         */
+        CompileStats statistics() const;
+
+        /**
+         * Prepare the emission of the circuit for the given options.
+         * @param version OpenQASM version, 3 or anything else for version 2
+         * @param parameterize True: Parameterize the circuit using the parameter indices of the input
+         * @param multiplier Optional; Multiplier to multiply all operators with, 2 by default
+         * @param coefficientInputs Declare coefficients as runtime inputs named `coef<n>`, version 3 only
+         * @param preamble Filled with the header and the input declarations preceding the operators
+         * @return Text of the rotation angle of an operator
+         */
+        std::function<std::string(const QuantumOperator &)> emission(int version,
+                                                                     bool parameterize,
+                                                                     const std::optional<double> &multiplier,
+                                                                     CoefficientInputs coefficientInputs,
+                                                                     std::string &preamble) const;
+
+        /**
+         * Generate the OpenQASM version specific header declaring the qubit and bit registers.
+         * @param version OpenQASM version, 3 or anything else for version 2
+         * @return Qasm string of the header
+         */
+        std::string qasmHeader(int version) const;
 
         /**
          * Generate different OpenQASM variables for the parameterization of the ansatz.
          * @param paramNames Distinct names for the parameter variables. These are the numerating numbers.
          * @return Qasm string of variable names.
          */
-        static std::string inputParamQasmVariable(std::vector<unsigned long>& paramNames);
+        static std::string inputParamQasmVariable(const std::vector<unsigned long>& paramNames);
+
+        /**
+         * Assign runtime coefficient inputs to the operators. Operators without active qubits get no input.
+         * @param mode Per operator or per distinct coefficient value inputs, Off assigns none
+         * @param inputs Filled with the number and value of each declared input, in order of first use
+         * @return Input number of each operator, ordered as the operators; 0 if it has none
+         */
+        std::vector<unsigned long> coefficientIds(CoefficientInputs mode,
+                                                  std::vector<std::pair<unsigned long, double> > &inputs) const;
 
     public:
-        friend std::string parseCircuit(const std::string &inFilename,
-                                        int version,
-                                        bool useOpenMP,
-                                        bool parameterize,
-                                        const std::optional<std::string> &outFilename,
-                                        const std::optional<float> &multiplier);
+        /**
+         * Read the input file and convert all operators into their integer representation.
+         * @param inFilename Path to input file containing ansatz circuit in string representation
+         * @param backend Parallel framework, Auto to choose by the amount and distribution of work
+         * @param cancel Optional; Token to cancel reading and converting, throws `Cancelled` once expired
+         */
+        explicit Parser(const std::string &inFilename,
+                        Backend backend = Backend::ExecutionPolicy,
+                        const CancellationToken &cancel = CancellationToken());
+
+        /**
+         * Emit the OpenQASM representation of the loaded operators. Input file is not touched again.
+         * @param version Set to integer value specifying version to use. Version 2 by default.
+         * @param backend Parallel framework, Auto to choose by the amount and distribution of work
+         * @param parameterize True: Parameterize the circuit using the parameter indices of the input
+         * @param outFilename Optional; If provided, write OpenQASM representation into this file.
+         * @param multiplier Optional; Multiplier to multiply all operators with, 2 by default
+         * @param coefficientInputs Declare coefficients as runtime inputs named `coef<n>`, version 3 only
+         * @param cancel Optional; Token to cancel the emission, throws `Cancelled` once expired
+         * @param stats Optional; Filled with the timings and sizes of reading, conversion and this emission
+         * @return OpenQASM version of loaded operators
+         */
+        std::string emit(int version = 2,
+                         Backend backend = Backend::ExecutionPolicy,
+                         bool parameterize = true,
+                         const std::optional<std::string> &outFilename = std::nullopt,
+                         const std::optional<double> &multiplier = std::nullopt,
+                         CoefficientInputs coefficientInputs = CoefficientInputs::Off,
+                         const CancellationToken &cancel = CancellationToken(),
+                         CompileStats *stats = nullptr) const;
+
+        /**
+         * Values of the runtime coefficient inputs `emit` declares for the given mode.
+         * @param mode Per operator or per distinct coefficient value inputs
+         * @return Name and value of each input, in order of declaration
+         */
+        std::vector<std::pair<std::string, double> > coefficientInputValues(CoefficientInputs mode) const;
+
+        /**
+         * Emit the circuit once as a template, recording the offset of every rotation angle. The template is bound to
+         * concrete parameter values without touching the operators again, see CircuitTemplate::bind.
+         * @param version Set to integer value specifying version to use. Version 2 by default.
+         * @param backend Parallel framework, Auto to choose by the amount and distribution of work
+         * @param multiplier Optional; Multiplier to multiply all operators with, 2 by default
+         * @return Template of the non-parameterized circuit
+         */
+        CircuitTemplate compileTemplate(int version = 2,
+                                        Backend backend = Backend::ExecutionPolicy,
+                                        const std::optional<double> &multiplier = std::nullopt) const;
+
+        /**
+         * Schedule the emission of this circuit runs with, as chosen by the worker pool. Parallel emission cuts the
+         * operators into chunks of about equal cost, so the grain size is 0 and `chunks` gives their number.
+         * @param backend Parallel framework, Auto to choose by the amount and distribution of work
+         * @return Backend and chunks of the emission loop
+         */
+        Schedule schedule(Backend backend = Backend::Auto) const;
+
+        /**
+         * @return Schedule the conversion of the operators ran with on construction
+         */
+        const Schedule &conversionSchedule() const { return conversion; }
+
+        /**
+         * @return Number of qubits of the circuit
+         */
+        unsigned long qubitCount() const { return numberQubits; }
+
+        /**
+         * @return Number of operators read from the input file
+         */
+        std::size_t operatorCount() const { return operators.size(); }
+
+        /**
+         * @return Distinct parameter indices in order of first occurrence
+         */
+        const std::vector<unsigned long> &parameters() const { return parameterIndices; }
+    };
+
+    /**
+     * OpenQASM representation of a circuit produced in ordered chunks: first the header with the input declarations,
+     * then the operator fragments in windows of about `windowWork` emitted gates. A background thread emits the windows
+     * ahead of the consumer, each window in parallel on the worker pool, and stops when `lookAhead` chunks are waiting,
+     * so memory stays bounded regardless of the circuit size. Closing or destroying the stream cancels the window
+     * being emitted.
+     */
+    class CircuitStream {
+    private:
+        static constexpr std::size_t windowWork = 1 << 16;   // Emitted gates per window of operators
+
+        /**
+         * Chunks shared between the producing thread and the consumer.
+         */
+        struct State {
+            std::mutex mtx;
+            std::condition_variable changed;                 // Chunk pushed or popped, or production ended
+            std::deque<std::string> chunks;                  // Chunks ready to be consumed, in order
+            std::exception_ptr error;                        // Exception ending the production early
+            bool done = false;                               // Producer has pushed its last chunk
+            bool stop = false;                               // Consumer is gone, producer quits
+            CancellationToken cancel;                        // Child of the caller's token, cancelled with `stop`
+        };
+
+        std::shared_ptr<State> state;
+        std::thread producer;
+
+    public:
+        /**
+         * Start emitting the circuit of a parsed input file in the background.
+         * @param parser Parsed input file, kept alive until the stream is destroyed
+         * @param version Set to integer value specifying version to use. Version 2 by default.
+         * @param backend Parallel framework of each window, Auto to choose by the amount and distribution of work
+         * @param parameterize True: Parameterize the circuit using the parameter indices of the input
+         * @param multiplier Optional; Multiplier to multiply all operators with, 2 by default
+         * @param coefficientInputs Declare coefficients as runtime inputs named `coef<n>`, version 3 only
+         * @param lookAhead Maximal number of chunks emitted ahead of the consumer, at least 1
+         * @param cancel Optional; Token to cancel the emission, `next` throws `Cancelled` once expired
+         */
+        CircuitStream(std::shared_ptr<const Parser> parser,
+                      int version = 2,
+                      Backend backend = Backend::ExecutionPolicy,
+                      bool parameterize = true,
+                      const std::optional<double> &multiplier = std::nullopt,
+                      CoefficientInputs coefficientInputs = CoefficientInputs::Off,
+                      std::size_t lookAhead = 2,
+                      const CancellationToken &cancel = CancellationToken());
+
+        CircuitStream(CircuitStream &&) = default;
+
+        /**
+         * Stop the background emission, see `close`.
+         */
+        ~CircuitStream();
+
+        /**
+         * Wait for the next chunk. Rethrows an exception that ended the emission, e.g. `Cancelled`.
+         * @return Next chunk of the representation, empty optional once all chunks were returned or after `close`
+         */
+        std::optional<std::string> next();
+
+        /**
+         * Stop the background emission early, for consumers that do not need the remaining chunks. Cancels the window
+         * being emitted, drops the waiting chunks and waits for the producing thread. The caller's token stays
+         * untouched.
+         */
+        void close();
     };
 
     /**
      * Parse input file into OpenQASM representation. Parallelism enabled by default if supported. OpenMP or Execution
      * Policy parallelism implementation.
      * @param inFilename Path to input file containing ansatz circuit in string representation
-     * @param useOpenMP True: Use OpenMP as parallel framework; False: Use execution policy as parallel framework
+     * @param backend Parallel framework, Auto to choose by the amount and distribution of work
      * @param version Set to integer value specifying version to use. Version 2 by default.
      * @param outFilename Optional; If provided, write OpenQASM representation into this file.
-     * @param multiplier Optional; Multiplier to multiply all operators with
+     * @param multiplier Optional; Multiplier to multiply all operators with, 2 by default
+     * @param coefficientInputs Declare coefficients as runtime inputs named `coef<n>`, version 3 only
+     * @param cancel Optional; Token to cancel the compile, throws `Cancelled` once expired
+     * @param stats Optional; Filled with the timings and sizes of the compile
      * @return OpenQASM version of input file
      */
     std::string parseCircuit(const std::string &inFilename,
                              int version = 2,
-                             bool useOpenMP = false,
+                             Backend backend = Backend::ExecutionPolicy,
+                             bool parameterize = true,
+                             const std::optional<std::string> &outFilename = std::nullopt,
+                             const std::optional<double> &multiplier = std::nullopt,
+                             CoefficientInputs coefficientInputs = CoefficientInputs::Off,
+                             const CancellationToken &cancel = CancellationToken(),
+                             CompileStats *stats = nullptr);
+
+    /**
+     * Parse many input files into OpenQASM representations on the shared worker pool. Files are processed in parallel,
+     * largest first, and the loops within a file run on the same framework as the loop over the files.
+     * @param inFilenames Paths to input files containing ansatz circuits in string representation
+     * @param version Set to integer value specifying version to use. Version 2 by default.
+     * @param backend Parallel framework, Auto to choose by the amount and distribution of work
+     * @param parameterize True: Parameterize the circuits using the parameter indices of the input
+     * @param outFilenames Optional; Empty or one entry per input file. If an entry is provided, write the OpenQASM
+     * representation of that input file into it.
+     * @param multiplier Optional; Multiplier to multiply all operators with, 2 by default
+     * @param coefficientInputs Declare coefficients as runtime inputs named `coef<n>`, version 3 only
+     * @param cancel Optional; Token to cancel all compiles of the batch, throws `Cancelled` once expired
+     * @return OpenQASM versions of the input files, in order of the input files
+     */
+    std::vector<std::string> parseCircuits(const std::vector<std::string> &inFilenames,
+                                           int version = 2,
+                                           Backend backend = Backend::ExecutionPolicy,
+                                           bool parameterize = true,
+                                           const std::vector<std::optional<std::string> > &outFilenames = {},
+                                           const std::optional<double> &multiplier = std::nullopt,
+                                           CoefficientInputs coefficientInputs = CoefficientInputs::Off,
+                                           const CancellationToken &cancel = CancellationToken());
+
+    /**
+     * Parse input file and stream its OpenQASM representation in ordered chunks, see CircuitStream.
+     * @param inFilename Path to input file containing ansatz circuit in string representation
+     * @param version Set to integer value specifying version to use. Version 2 by default.
+     * @param backend Parallel framework, Auto to choose by the amount and distribution of work
+     * @param parameterize True: Parameterize the circuit using the parameter indices of the input
+     * @param multiplier Optional; Multiplier to multiply all operators with, 2 by default
+     * @param coefficientInputs Declare coefficients as runtime inputs named `coef<n>`, version 3 only
+     * @param lookAhead Maximal number of chunks emitted ahead of the consumer, at least 1
+     * @param cancel Optional; Token to cancel reading and emission, throws `Cancelled` once expired
+     * @return Stream of the OpenQASM representation
+     */
+    CircuitStream streamCircuit(const std::string &inFilename,
+                                int version = 2,
+                                Backend backend = Backend::ExecutionPolicy,
+                                bool parameterize = true,
+                                const std::optional<double> &multiplier = std::nullopt,
+                                CoefficientInputs coefficientInputs = CoefficientInputs::Off,
+                                std::size_t lookAhead = 2,
+                                const CancellationToken &cancel = CancellationToken());
+
+    /**
+     * Parse input file into OpenQASM representation, choosing the parallel framework by a flag.
+     * @param useOpenMP True: Use OpenMP as parallel framework; False: Use execution policy as parallel framework
+     */
+    std::string parseCircuit(const std::string &inFilename,
+                             int version,
+                             bool useOpenMP,
                              bool parameterize = true,
                              const std::optional<std::string> &outFilename = std::nullopt,
-                             const std::optional<float> &multiplier = std::nullopt);
+                             const std::optional<double> &multiplier = std::nullopt,
+                             CoefficientInputs coefficientInputs = CoefficientInputs::Off);
 }
 
 #endif //QASM_PARSER_PARSER_H
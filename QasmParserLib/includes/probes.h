@@ -0,0 +1,67 @@
+//
+// Static tracepoints (USDT) at the phase boundaries and parallel chunks of a compile.
+//
+
+#ifndef QASM_PARSER_PROBES_H
+#define QASM_PARSER_PROBES_H
+
+#include <cstddef>
+
+
+/**
+ * Probes of provider `qasmparser`, built on SystemTap's <sys/sdt.h> where available. A probe compiles to a single nop
+ * and a note in the ELF file, tools like bpftrace or `perf probe` patch it into a trap only while they are attached,
+ * so production builds keep them. Builds without the header, or configured with `QASMPARSER_NO_PROBES`, expand the
+ * macros to nothing.
+ *
+ * Phase probes fire on the thread calling the compile, `*_start` and `*_done` of a phase on the same thread:
+ *   read_start(path), read_done(terms, bytes in)
+ *   convert_start(terms), convert_done(terms)
+ *   emit_start(terms), emit_done(terms)
+ *   assemble_start(fragments), assemble_done(bytes out)
+ *   write_start(path), write_done(bytes out)
+ * Chunk probes fire on the thread working on a chunk of a parallel loop:
+ *   chunk_start(label, items), chunk_done(label, items)
+ */
+#if !defined(QASMPARSER_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define QASMPARSER_HAS_PROBES 1
+#endif
+#endif
+
+#ifdef QASMPARSER_HAS_PROBES
+#define QASMPARSER_PROBE1(name, a) DTRACE_PROBE1(qasmparser, name, a)
+#define QASMPARSER_PROBE2(name, a, b) DTRACE_PROBE2(qasmparser, name, a, b)
+#else
+#define QASMPARSER_PROBE1(name, a) do {} while (0)
+#define QASMPARSER_PROBE2(name, a, b) do {} while (0)
+#endif
+
+namespace qasmparser {
+    /**
+     * Fires `chunk_start` on construction and `chunk_done` on destruction, also if the chunk throws.
+     */
+    class ChunkProbe {
+    private:
+        const char *label;                                   // Static label of the chunk, nullptr to not fire
+        std::size_t items;                                   // Number of elements of the chunk
+
+    public:
+        ChunkProbe(const char *label, const std::size_t items) : label(label), items(items) {
+            if (label)
+                QASMPARSER_PROBE2(chunk_start, label, items);
+        }
+
+        ~ChunkProbe() {
+            if (label)
+                QASMPARSER_PROBE2(chunk_done, label, items);
+        }
+
+        ChunkProbe(const ChunkProbe &) = delete;
+
+        ChunkProbe &operator=(const ChunkProbe &) = delete;
+    };
+}
+
+#endif //QASM_PARSER_PROBES_H
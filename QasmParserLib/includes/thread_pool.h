@@ -0,0 +1,381 @@
+//
+// Persistent worker pool shared by the parallel loops of the parser.
+//
+
+#ifndef QASM_PARSER_THREAD_POOL_H
+#define QASM_PARSER_THREAD_POOL_H
+
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+#include <omp.h>
+
+#include <algorithm>
+#include <exception>
+#include <execution>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "hardware_counters.h"
+#include "probes.h"
+#include "trace.h"
+
+namespace qasmparser {
+    class ThreadPool;
+
+    namespace detail {
+        extern thread_local ThreadPool *currentPool;         // Pool `threadPool` returns on this thread, if set
+    }
+
+    /**
+     * Parallel framework a loop runs on. Auto lets the pool choose based on the amount and distribution of work.
+     */
+    enum class Backend {
+        Sequential,
+        OpenMP,
+        ExecutionPolicy,
+        Auto
+    };
+
+    /**
+     * Backend and chunking chosen for a parallel loop.
+     */
+    struct Schedule {
+        Backend backend;                                     // Backend the loop runs on, never Auto
+        std::size_t grainSize;                               // Elements per chunk, 0 for chunks of about equal cost
+        std::size_t chunks = 0;                              // Number of chunks handed to the threads
+    };
+
+    /**
+     * Library-owned persistent worker pool shared by all calls. The execution policy path runs inside the pool's task
+     * arena, whose worker threads stay alive between calls, and the OpenMP path uses a team of the same size, which
+     * the OpenMP runtime keeps alive as well. Optionally every worker thread is pinned to a core: the arena workers
+     * whenever they join the arena, the OpenMP team of the thread creating the pool up front. OpenMP keeps a team per
+     * calling thread, the teams of other callers are not pinned. An unpinned pool releases threads an earlier pinned
+     * pool pinned back to the cores of the process.
+     */
+    class ThreadPool {
+    private:
+        class Pinning;                                       // Observer pinning arena workers to cores
+
+        /**
+         * First exception thrown inside an OpenMP region or a parallel algorithm. An exception leaving either would
+         * terminate the process, so it is caught on the throwing thread and rethrown on the calling thread once the
+         * loop has ended.
+         */
+        class ErrorSlot {
+        private:
+            std::exception_ptr error;
+            std::mutex mtx;
+
+        public:
+            template <typename G>
+            void run(const G &g) noexcept {
+                try {
+                    g();
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> guard(mtx);
+                    if (!error)
+                        error = std::current_exception();
+                }
+            }
+
+            void rethrow() {
+                if (error)
+                    std::rethrow_exception(error);
+            }
+        };
+
+        /**
+         * Makes a pool the one `threadPool` returns on the calling thread until destruction, so loops nested in a
+         * chunk run on the pool of the enclosing loop.
+         */
+        class Scope {
+        private:
+            ThreadPool *previous;
+
+        public:
+            explicit Scope(ThreadPool *pool) : previous(detail::currentPool) { detail::currentPool = pool; }
+
+            ~Scope() { detail::currentPool = previous; }
+
+            Scope(const Scope &) = delete;
+
+            Scope &operator=(const Scope &) = delete;
+        };
+
+        std::size_t threads;                                 // Number of threads working on a parallel loop
+        bool pinCores;                                       // Pin worker threads to cores
+        std::unique_ptr<tbb::global_control> parallelism;    // Lift TBB's worker limit to `threads`, shared pool only
+        tbb::task_arena arena;                               // Arena the execution policies run in
+        std::unique_ptr<Pinning> pinning;
+
+    public:
+        /**
+         * Create the worker pool. Threads are started and, if requested, pinned up front.
+         * @param threads Number of threads, 0 to use all cores
+         * @param pinCores True: Pin worker thread `i` to core `i` modulo the number of cores
+         */
+        ThreadPool(std::size_t threads, bool pinCores);
+
+        /**
+         * Pool limited to fewer threads than `parent` for the duration of a call, with an arena and an OpenMP team
+         * size of its own. It leaves the process-wide TBB worker limit and the pinning of `parent` untouched, so
+         * concurrent calls with different limits do not interfere.
+         * @param parent Pool to take the threads from
+         * @param threads Number of threads, at most those of `parent`
+         */
+        ThreadPool(const ThreadPool &parent, std::size_t threads);
+
+        ~ThreadPool();
+
+        /**
+         * @return Number of threads working on a parallel loop, including the calling thread
+         */
+        std::size_t size() const { return threads; }
+
+        /**
+         * @return True if worker threads are pinned to cores
+         */
+        bool pinned() const { return pinCores; }
+
+        /**
+         * Choose backend and grain size of a loop. Auto runs small loops sequentially, loops with a few elements much
+         * heavier than the rest on OpenMP with dynamic scheduling, and all others on the execution policies. The grain
+         * size aims at several chunks per thread, each large enough to outweigh the scheduling overhead.
+         * @param backend Requested backend, Auto to let the pool choose
+         * @param items Number of elements of the loop
+         * @param work Estimated total cost of all elements, in emitted gates
+         * @param maxWork Estimated cost of the most expensive element, in emitted gates
+         * @return Schedule to run the loop with
+         */
+        Schedule schedule(Backend backend, std::size_t items, std::size_t work, std::size_t maxWork) const;
+
+        /**
+         * Apply a function to each element of a range on the pool's threads, in chunks of the schedule's grain size.
+         * @param schedule Backend and grain size, see `schedule`
+         * @param first Random access iterator to the first element
+         * @param last Random access iterator past the last element
+         * @param f Function applied to each element
+         * @param label Name of the chunks in a trace and in the chunk probes, nullptr to not trace them
+         */
+        template <typename It, typename F>
+        void forEach(const Schedule &schedule, It first, It last, const F &f, const char *label = "chunk");
+
+        /**
+         * Order elements by cost class, heaviest first, and cut the order into chunks of about equal cost. Cost
+         * classes are powers of two, so ordering takes linear time and keeps the original order within a class.
+         * Elements heavier than a chunk form a chunk on their own.
+         * @param costs Estimated cost of each element, in emitted gates
+         * @param order Filled with the element indices in processing order
+         * @param bounds Filled with the chunk boundaries in `order`, from 0 to the number of elements
+         */
+        void balance(const std::vector<std::size_t> &costs,
+                     std::vector<std::size_t> &order,
+                     std::vector<std::size_t> &bounds) const;
+
+        /**
+         * Schedule `forEachWeighted` runs a loop with. A parallel loop is cut by `balance` instead of the grain size,
+         * its grain size is reported as 0.
+         * @param schedule Backend of the loop, see `schedule`
+         * @param costs Estimated cost of each element, in emitted gates
+         * @return Backend and chunks of the loop
+         */
+        Schedule weighted(const Schedule &schedule, const std::vector<std::size_t> &costs) const;
+
+        /**
+         * Apply a function to each element index in parallel, heaviest elements first and in chunks of about equal
+         * cost (longest processing time first). The order elements are processed in does not affect the result as
+         * long as `f` writes to a slot of its own.
+         * @param schedule Backend of the loop, its grain size is replaced by cost-balanced chunks
+         * @param costs Estimated cost of each element, in emitted gates
+         * @param f Function applied to each element index
+         * @param label Name of the chunks in a trace and in the chunk probes
+         */
+        template <typename F>
+        void forEachWeighted(const Schedule &schedule,
+                             const std::vector<std::size_t> &costs,
+                             const F &f,
+                             const char *label = "chunk");
+
+        /**
+         * Run parts of a single element as tasks, from inside or outside a parallel loop. OpenMP spawns a taskloop in
+         * the enclosing team, idle threads of the team pick up the parts; the execution policy path runs a TBB task
+         * group in the pool's arena, idle workers steal the parts.
+         * @param backend Backend of the enclosing loop
+         * @param parts Number of parts
+         * @param f Function applied to each part index
+         */
+        template <typename F>
+        void nested(Backend backend, std::size_t parts, const F &f);
+
+        /**
+         * Run a function asynchronously on one of the pool's worker threads. The function must not throw.
+         * @param f Function to run
+         */
+        template <typename F>
+        void submit(F &&f) { arena.enqueue(std::forward<F>(f)); }
+    };
+
+    template <typename It, typename F>
+    void ThreadPool::forEach(const Schedule &schedule, It first, It last, const F &f, const char *label) {
+        const std::ptrdiff_t n = last - first;
+        const std::ptrdiff_t grain = std::max<std::ptrdiff_t>(static_cast<std::ptrdiff_t>(schedule.grainSize), 1);
+        const auto chunk = [&](const std::ptrdiff_t begin) {
+            const std::ptrdiff_t end = std::min(begin + grain, n);
+            const TraceSpan span(label, static_cast<std::size_t>(end - begin));
+            const ChunkProbe probe(label, static_cast<std::size_t>(end - begin));
+            const Scope scope(this);
+            countThread();
+            for (std::ptrdiff_t i = begin; i < end; i++)
+                f(first[i]);
+        };
+
+        switch (schedule.backend) {
+            case Backend::OpenMP: {
+                // Dynamic scheduling of whole chunks, the same as a chunk size of `grain`
+                ErrorSlot error;
+                #pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+                for (std::ptrdiff_t begin = 0; begin < n; begin += grain)
+                    error.run([&] { chunk(begin); });
+                error.rethrow();
+                break;
+            }
+            case Backend::ExecutionPolicy: {
+                // Execution policies do not take a chunk size, hand them whole chunks instead
+                std::vector<std::ptrdiff_t> chunks((n + grain - 1) / grain);
+                for (std::size_t c = 0; c < chunks.size(); c++)
+                    chunks[c] = static_cast<std::ptrdiff_t>(c) * grain;
+
+                // An exception leaving a parallel algorithm terminates the process, it is caught the same way
+                ErrorSlot error;
+                arena.execute([&] {
+                    std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](const std::ptrdiff_t begin) {
+                        error.run([&] { chunk(begin); });
+                    });
+                });
+                error.rethrow();
+                break;
+            }
+            default: {
+                const TraceSpan span(label, static_cast<std::size_t>(n));
+                const ChunkProbe probe(label, static_cast<std::size_t>(n));
+                std::for_each(first, last, f);
+            }
+        }
+    }
+
+    template <typename F>
+    void ThreadPool::forEachWeighted(const Schedule &schedule,
+                                     const std::vector<std::size_t> &costs,
+                                     const F &f,
+                                     const char *label) {
+        if (schedule.backend == Backend::Sequential) {
+            const TraceSpan span(label, costs.size());
+            const ChunkProbe probe(label, costs.size());
+            for (std::size_t i = 0; i < costs.size(); i++)
+                f(i);
+            return;
+        }
+
+        std::vector<std::size_t> order, bounds;
+        balance(costs, order, bounds);
+
+        // Chunks are handed out one at a time, the heaviest first
+        forEach(Schedule{schedule.backend, 1}, bounds.begin(), bounds.end() - 1, [&](const std::size_t &begin) {
+            const std::size_t end = (&begin)[1];
+            const TraceSpan span(label, end - begin);
+            const ChunkProbe probe(label, end - begin);
+            countThread();
+            for (std::size_t k = begin; k < end; k++)
+                f(order[k]);
+        }, nullptr);
+    }
+
+    template <typename F>
+    void ThreadPool::nested(const Backend backend, const std::size_t parts, const F &f) {
+        const auto n = static_cast<std::ptrdiff_t>(parts);
+
+        switch (backend) {
+            case Backend::OpenMP: {
+                ErrorSlot error;
+                const auto part = [&](const std::ptrdiff_t p) {
+                    const Scope scope(this);
+                    f(static_cast<std::size_t>(p));
+                };
+                if (omp_in_parallel()) {
+                    #pragma omp taskloop grainsize(1) shared(error)
+                    for (std::ptrdiff_t p = 0; p < n; p++)
+                        error.run([&] { part(p); });
+                } else {
+                    #pragma omp parallel num_threads(threads)
+                    #pragma omp single
+                    #pragma omp taskloop grainsize(1) shared(error)
+                    for (std::ptrdiff_t p = 0; p < n; p++)
+                        error.run([&] { part(p); });
+                }
+                error.rethrow();
+                break;
+            }
+            case Backend::ExecutionPolicy: {
+                arena.execute([&] {
+                    tbb::task_group group;
+                    for (std::size_t p = 0; p < parts; p++)
+                        group.run([this, &f, p] {
+                            const Scope scope(this);
+                            f(p);
+                        });
+                    group.wait();
+                });
+                break;
+            }
+            default:
+                for (std::size_t p = 0; p < parts; p++)
+                    f(p);
+        }
+    }
+
+    /**
+     * Library-wide worker pool, created on first use. Its size is taken from the environment variable
+     * QASMPARSER_NUM_THREADS, all cores if unset or not a positive number, and its threads are pinned if
+     * QASMPARSER_PIN_THREADS is set to 1. Callers keep the returned pointer for the duration of a call, so reconfiguring does not pull the pool from under
+     * running calls. Inside a `ThreadLimit`, and on threads working on a chunk of its loops, the limited pool is
+     * returned instead.
+     * @return Shared pointer to the current pool
+     */
+    std::shared_ptr<ThreadPool> threadPool();
+
+    /**
+     * Limits the parallel loops of all calls the constructing thread makes until destruction to a number of threads
+     * of the library-wide pool, without resizing it. Calls in other threads keep the full pool.
+     */
+    class ThreadLimit {
+    private:
+        std::shared_ptr<ThreadPool> pool;                    // Limited pool, nullptr if not limited
+        ThreadPool *previous;                                // Pool of the enclosing scope, restored on destruction
+
+    public:
+        /**
+         * @param threads Maximal number of threads, 0 for the full library-wide pool
+         */
+        explicit ThreadLimit(std::size_t threads);
+
+        ~ThreadLimit();
+
+        ThreadLimit(const ThreadLimit &) = delete;
+
+        ThreadLimit &operator=(const ThreadLimit &) = delete;
+    };
+
+    /**
+     * Replace the library-wide worker pool if its configuration differs. Running calls finish on the old pool.
+     * @param threads Number of threads, 0 to use all cores
+     * @param pinCores True: Pin worker threads to cores, false: Release threads pinned by the old pool
+     */
+    void configureThreadPool(std::size_t threads = 0, bool pinCores = false);
+}
+
+#endif //QASM_PARSER_THREAD_POOL_H
@@ -0,0 +1,92 @@
+//
+// Per-thread timeline of the parser's phases and parallel chunks, exported as Chrome trace JSON.
+//
+
+#ifndef QASM_PARSER_TRACE_H
+#define QASM_PARSER_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+
+namespace qasmparser {
+    namespace detail {
+        extern std::atomic<int> activeTraces;                // Number of open trace sessions
+
+        /**
+         * @return Nanoseconds on the steady clock
+         */
+        std::uint64_t traceNow();
+
+        /**
+         * Append a finished span to the ring buffer of the calling thread.
+         */
+        void recordSpan(const char *name, std::uint64_t begin, std::uint64_t end, std::size_t items);
+    }
+
+    /**
+     * Span of work on the calling thread, from construction to destruction. Spans are only recorded while a
+     * `TraceSession` is open, otherwise a span costs a single relaxed load.
+     */
+    class TraceSpan {
+    private:
+        const char *name;                                    // Static label of the span
+        std::size_t items;                                   // Number of elements the span worked on
+        std::uint64_t begin = 0;                             // Start in nanoseconds, 0 if not recorded
+
+    public:
+        /**
+         * @param name Label shown in the timeline, must outlive the trace session, nullptr to not record the span
+         * @param items Number of elements the span works on, 0 if not applicable
+         */
+        explicit TraceSpan(const char *name, const std::size_t items = 0) : name(name), items(items) {
+            if (name && detail::activeTraces.load(std::memory_order_relaxed) > 0)
+                begin = detail::traceNow();
+        }
+
+        ~TraceSpan() {
+            if (begin != 0)
+                detail::recordSpan(name, begin, detail::traceNow(), items);
+        }
+
+        TraceSpan(const TraceSpan &) = delete;
+
+        TraceSpan &operator=(const TraceSpan &) = delete;
+    };
+
+    /**
+     * Records the spans of all threads from construction until the trace is written. Every thread appends to a ring
+     * buffer of its own, so recording threads never contend, and only the most recent spans of each thread are kept.
+     * Spans of concurrent compiles in other threads of the process show up in the same timeline.
+     */
+    class TraceSession {
+    private:
+        std::uint64_t start;                                 // Spans starting earlier are not part of the session
+        bool open = true;
+
+    public:
+        TraceSession();
+
+        ~TraceSession();
+
+        TraceSession(const TraceSession &) = delete;
+
+        TraceSession &operator=(const TraceSession &) = delete;
+
+        /**
+         * Stop recording and collect the spans of the session. Complete events carry the number of elements a span
+         * worked on, `truncatedThreads` counts threads whose ring overflowed during the session.
+         * @return Chrome trace JSON, viewable in Perfetto or chrome://tracing
+         */
+        std::string finish();
+
+        /**
+         * Stop recording and write the spans of the session to a file.
+         * @param outFilename Path of the JSON file, throws runtime_error if it cannot be written
+         */
+        void write(const std::string &outFilename);
+    };
+}
+
+#endif //QASM_PARSER_TRACE_H
@@ -0,0 +1,235 @@
+//
+// Seeded synthetic Hamiltonians in the input format of the parser.
+//
+
+#include "generator.h"
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace {
+    constexpr std::size_t blockBytes = 1 << 20;              // Output bytes aimed at per block
+    constexpr std::size_t lineOverhead = 24;                 // Coefficient, parameter and separators of a line
+    constexpr std::size_t blocksPerThread = 4;               // Blocks per thread generated before writing a window
+
+    /**
+     * SplitMix64 generator, seeded per block so the output does not depend on the thread schedule.
+     */
+    class SplitMix64 {
+    private:
+        std::uint64_t state;
+
+    public:
+        explicit SplitMix64(const std::uint64_t seed) : state(seed) {}
+
+        std::uint64_t operator()() {
+            std::uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+
+        /**
+         * @return Uniform integer in [0, n)
+         */
+        std::size_t below(const std::size_t n) {
+            return static_cast<std::size_t>((static_cast<unsigned __int128>((*this)()) * n) >> 64);
+        }
+
+        /**
+         * @return Uniform double in [0, 1)
+         */
+        double unit() { return static_cast<double>((*this)() >> 11) * 0x1.0p-53; }
+    };
+
+    void validate(const qasmparser::GeneratorOptions &options) {
+        if (options.qubits == 0)
+            throw std::invalid_argument("Hamiltonian needs at least one qubit!");
+        if (options.family == qasmparser::HamiltonianFamily::Lattice) {
+            if (options.latticeWidth > options.qubits)
+                throw std::invalid_argument("Lattice wider than the number of qubits!");
+            return;
+        }
+        const std::size_t maxWeight = options.family == qasmparser::HamiltonianFamily::FixedWeight
+                                      ? options.minWeight : options.maxWeight;
+        if (options.minWeight == 0 || options.minWeight > maxWeight || maxWeight > options.qubits)
+            throw std::invalid_argument(fmt::format("Weights must satisfy 1 <= {} <= {} <= {} qubits!",
+                                                    options.minWeight, maxWeight, options.qubits));
+    }
+
+    /**
+     * @return Terms per block, so a block holds about `blockBytes` of output
+     */
+    std::size_t blockTerms(const qasmparser::GeneratorOptions &options) {
+        return std::max<std::size_t>(blockBytes / (options.qubits + lineOverhead), 1);
+    }
+
+    /**
+     * Nearest-neighbour pairs of a square lattice filled row by row, a chain if the width is 0.
+     */
+    std::vector<std::pair<unsigned long, unsigned long> > latticeEdges(const qasmparser::GeneratorOptions &options) {
+        std::vector<std::pair<unsigned long, unsigned long> > edges;
+        if (options.family != qasmparser::HamiltonianFamily::Lattice)
+            return edges;
+
+        const unsigned long width = options.latticeWidth == 0 ? options.qubits : options.latticeWidth;
+        for (unsigned long site = 0; site < options.qubits; site++) {
+            if ((site + 1) % width != 0 && site + 1 < options.qubits)
+                edges.emplace_back(site, site + 1);
+            if (site + width < options.qubits)
+                edges.emplace_back(site, site + width);
+        }
+        return edges;
+    }
+
+    /**
+     * Activate `weight` distinct random qubits of an all-identity string with random Pauli operators.
+     */
+    void activate(std::string &op, const std::size_t weight, SplitMix64 &rng) {
+        const std::size_t n = op.size();
+        if (2 * weight <= n) {
+            for (std::size_t w = 0; w < weight;) {
+                auto &ch = op[rng.below(n)];
+                if (ch == 'I') {
+                    ch = "XYZ"[rng.below(3)];
+                    w++;
+                }
+            }
+            return;
+        }
+
+        // Dense strings: activate all qubits and clear the surplus, so rejection stays cheap
+        for (auto &ch : op)
+            ch = "XYZ"[rng.below(3)];
+        for (std::size_t w = n; w > weight;) {
+            auto &ch = op[rng.below(n)];
+            if (ch != 'I') {
+                ch = 'I';
+                w--;
+            }
+        }
+    }
+
+    /**
+     * Generate the terms of one block and append their lines to `out`.
+     * @param options Family, size and seed of the Hamiltonian
+     * @param edges Lattice edges, empty for other families
+     * @param block Index of the block
+     * @param out String the lines are appended to
+     */
+    void generateBlock(const qasmparser::GeneratorOptions &options,
+                       const std::vector<std::pair<unsigned long, unsigned long> > &edges,
+                       const std::size_t block,
+                       std::string &out) {
+        const std::size_t perBlock = blockTerms(options);
+        const std::size_t first = block * perBlock;
+        const std::size_t last = std::min(options.terms, first + perBlock);
+
+        SplitMix64 seeder(options.seed ^ (static_cast<std::uint64_t>(options.family) << 32));
+        SplitMix64 rng(seeder() ^ (block * 0xD1B54A32D192ED03ULL));
+        std::string op(options.qubits, 'I');
+        out.reserve((last - first) * (options.qubits + lineOverhead));
+
+        for (std::size_t t = first; t < last; t++) {
+            std::fill(op.begin(), op.end(), 'I');
+            switch (options.family) {
+                case qasmparser::HamiltonianFamily::RandomSparse:
+                    activate(op, options.minWeight + rng.below(options.maxWeight - options.minWeight + 1), rng);
+                    break;
+                case qasmparser::HamiltonianFamily::FixedWeight:
+                    activate(op, options.minWeight, rng);
+                    break;
+                case qasmparser::HamiltonianFamily::JordanWigner: {
+                    const std::size_t length = options.minWeight + rng.below(options.maxWeight - options.minWeight + 1);
+                    const std::size_t a = rng.below(options.qubits - length + 1), b = a + length - 1;
+                    std::fill(op.begin() + static_cast<std::ptrdiff_t>(a), op.begin() + static_cast<std::ptrdiff_t>(b),
+                              'Z');
+                    op[a] = "XY"[rng.below(2)];
+                    op[b] = "XY"[rng.below(2)];
+                    break;
+                }
+                case qasmparser::HamiltonianFamily::Lattice: {
+                    // Cycle through XX, YY and ZZ of every edge, single-site Z if there are no edges
+                    if (edges.empty()) {
+                        op[t % options.qubits] = 'Z';
+                        break;
+                    }
+                    const auto &[a, b] = edges[(t / 3) % edges.size()];
+                    op[a] = op[b] = "XYZ"[t % 3];
+                    break;
+                }
+            }
+
+            const double magnitude = 0.01 + 0.99 * rng.unit();
+            const double coef = rng() & 1 ? magnitude : -magnitude;
+            const std::size_t param = options.parameters == 0 ? 0 : 1 + rng.below(options.parameters);
+            out += op;
+            fmt::format_to(std::back_inserter(out), " {:.6g} {}\n", coef, param);
+        }
+    }
+
+    /**
+     * Generate a range of blocks in parallel, one string per block.
+     */
+    void generateBlocks(const qasmparser::GeneratorOptions &options,
+                        const std::vector<std::pair<unsigned long, unsigned long> > &edges,
+                        const qasmparser::Backend backend,
+                        const std::size_t firstBlock,
+                        std::vector<std::string> &blocks) {
+        // Work in emitted gates of about 16 bytes, a block is a single element of the loop
+        const std::size_t work = blockTerms(options) * (options.qubits + lineOverhead) / 16 + 1;
+        const auto pool = qasmparser::threadPool();
+        pool->forEach(pool->schedule(backend, blocks.size(), blocks.size() * work, work),
+                      blocks.begin(), blocks.end(), [&](std::string &out) {
+                          generateBlock(options, edges, firstBlock + (&out - blocks.data()), out);
+                      }, "generate blocks");
+    }
+}
+
+std::string qasmparser::generateHamiltonian(const GeneratorOptions &options, const Backend backend) {
+    validate(options);
+    const auto edges = latticeEdges(options);
+    const std::size_t perBlock = blockTerms(options);
+
+    std::vector<std::string> blocks((options.terms + perBlock - 1) / perBlock);
+    generateBlocks(options, edges, backend, 0, blocks);
+
+    std::size_t size = 0;
+    for (const auto &block : blocks)
+        size += block.size();
+    std::string text;
+    text.reserve(size);
+    for (const auto &block : blocks)
+        text += block;
+    return text;
+}
+
+void qasmparser::writeHamiltonian(const GeneratorOptions &options, const std::string &outFilename,
+                                  const Backend backend) {
+    validate(options);
+    std::ofstream outFile(outFilename, std::ios::binary);
+    if (!outFile.is_open())
+        throw std::runtime_error(fmt::format("Cannot write {}!", outFilename));
+
+    const auto edges = latticeEdges(options);
+    const std::size_t perBlock = blockTerms(options);
+    const std::size_t totalBlocks = (options.terms + perBlock - 1) / perBlock;
+    const std::size_t window = threadPool()->size() * blocksPerThread;
+
+    // Generate a window of blocks in parallel, then write it in order while keeping only one window in memory
+    std::vector<std::string> blocks;
+    for (std::size_t first = 0; first < totalBlocks; first += window) {
+        blocks.assign(std::min(window, totalBlocks - first), std::string());
+        generateBlocks(options, edges, backend, first, blocks);
+        for (const auto &block : blocks)
+            outFile.write(block.data(), static_cast<std::streamsize>(block.size()));
+        if (!outFile.good())
+            throw std::runtime_error(fmt::format("Cannot write {}!", outFilename));
+    }
+}
@@ -0,0 +1,161 @@
+//
+// Hardware performance counters per phase of a compile, read through Linux perf_event_open.
+//
+
+#include "hardware_counters.h"
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <array>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+
+namespace {
+    constexpr std::array<std::uint64_t, 4> events = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                     PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+    /**
+     * Counter group of one thread, led by the cycle counter so all events are scheduled together.
+     */
+    struct ThreadCounters {
+        std::array<int, events.size()> fds{-1, -1, -1, -1};
+
+        /**
+         * Open the group on the calling thread.
+         * @return False if the kernel refused any of the counters
+         */
+        bool open() {
+            for (std::size_t e = 0; e < events.size(); e++) {
+                perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = events[e];
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+                fds[e] = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, e == 0 ? -1 : fds[0], 0));
+                if (fds[e] < 0)
+                    return false;
+            }
+            return true;
+        }
+
+        /**
+         * Add the current counts of the group, scaled for multiplexing, to `sum`.
+         */
+        void read(qasmparser::HardwareCounters &sum) const {
+            // Number of events, time enabled, time running, then one value per event
+            std::array<std::uint64_t, 3 + events.size()> data{};
+            if (::read(fds[0], data.data(), sizeof(data)) != static_cast<ssize_t>(sizeof(data)) || data[2] == 0)
+                return;
+            const double scale = static_cast<double>(data[1]) / static_cast<double>(data[2]);
+            auto scaled = [scale](const std::uint64_t value) {
+                return static_cast<std::uint64_t>(static_cast<double>(value) * scale);
+            };
+            sum.cycles += scaled(data[3]);
+            sum.instructions += scaled(data[4]);
+            sum.cacheMisses += scaled(data[5]);
+            sum.branchMisses += scaled(data[6]);
+        }
+
+        ~ThreadCounters() {
+            for (const int fd : fds)
+                if (fd >= 0)
+                    ::close(fd);
+        }
+    };
+
+    std::mutex registryMtx;
+    std::vector<std::shared_ptr<ThreadCounters> > threads;  // Counters of all counted threads that are alive
+    qasmparser::HardwareCounters retired;                    // Final counts of counted threads that have exited
+
+    /**
+     * Moves the counts of a thread to `retired` when it exits, its counters close with it.
+     */
+    struct CounterOwner {
+        std::shared_ptr<ThreadCounters> counters;
+
+        ~CounterOwner() {
+            if (!counters)
+                return;
+            std::lock_guard<std::mutex> guard(registryMtx);
+            counters->read(retired);
+            for (auto it = threads.begin(); it != threads.end(); ++it)
+                if (*it == counters) {
+                    threads.erase(it);
+                    break;
+                }
+        }
+    };
+
+    /**
+     * @return Counts of all counted threads since they were attached
+     */
+    qasmparser::HardwareCounters total() {
+        std::lock_guard<std::mutex> guard(registryMtx);
+        qasmparser::HardwareCounters sum = retired;
+        for (const auto &counters : threads)
+            counters->read(sum);
+        return sum;
+    }
+}
+
+std::atomic<bool> qasmparser::detail::countersEnabled{false};
+
+void qasmparser::detail::attachCounters() {
+    thread_local CounterOwner owner;
+    thread_local bool tried = false;
+    if (tried)
+        return;
+    tried = true;
+
+    auto counters = std::make_shared<ThreadCounters>();
+    if (!counters->open())
+        return;
+    owner.counters = counters;
+    std::lock_guard<std::mutex> guard(registryMtx);
+    threads.push_back(std::move(counters));
+}
+
+bool qasmparser::enableHardwareCounters(const bool enable) {
+    if (!enable) {
+        detail::countersEnabled.store(false, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Probe on the calling thread, a kernel refusing it refuses the workers as well
+    ThreadCounters probe;
+    const bool available = probe.open();
+    detail::countersEnabled.store(available, std::memory_order_relaxed);
+    return available;
+}
+
+qasmparser::CounterPhase::CounterPhase() {
+    countThread();
+    if (hardwareCountersEnabled()) {
+        start = total();
+        start.valid = true;
+    }
+}
+
+qasmparser::HardwareCounters qasmparser::CounterPhase::finish() const {
+    // Counting must have been enabled for the whole phase
+    HardwareCounters counters;
+    if (!start.valid || !hardwareCountersEnabled())
+        return counters;
+
+    // Scaling for multiplexing is an estimate, it may let a count shrink slightly
+    auto delta = [](const std::uint64_t end, const std::uint64_t begin) { return end > begin ? end - begin : 0; };
+    const HardwareCounters end = total();
+    counters.valid = true;
+    counters.cycles = delta(end.cycles, start.cycles);
+    counters.instructions = delta(end.instructions, start.instructions);
+    counters.cacheMisses = delta(end.cacheMisses, start.cacheMisses);
+    counters.branchMisses = delta(end.branchMisses, start.branchMisses);
+    return counters;
+}
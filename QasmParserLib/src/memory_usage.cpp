@@ -0,0 +1,145 @@
+//
+// Allocation and peak-memory accounting per phase of a compile.
+//
+
+#include "memory_usage.h"
+#include "fmt/core.h"
+
+#include <malloc.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <new>
+
+
+namespace {
+    // Process-wide counters, constant-initialized so allocations during static initialization are counted as well
+    std::atomic<std::size_t> allocationCount{0};
+    std::atomic<std::size_t> allocatedBytes{0};
+    std::atomic<std::size_t> liveBytes{0};
+
+    // High-water marks of the open phases, a set bit in `openPhases` marks a slot in use
+    std::atomic<std::uint64_t> openPhases{0};
+    std::array<std::atomic<std::size_t>, qasmparser::MemoryPhase::maxPhases> phasePeaks{};
+
+    std::mutex reportMtx;
+
+#ifdef QASMPARSER_MEMORY_ACCOUNTING
+    void raisePeak(std::atomic<std::size_t> &peak, const std::size_t live) {
+        std::size_t current = peak.load(std::memory_order_relaxed);
+        while (live > current && !peak.compare_exchange_weak(current, live, std::memory_order_relaxed)) {}
+    }
+
+    void *counted(void *ptr) {
+        if (!ptr)
+            throw std::bad_alloc();
+
+        // The usable size is known again on free, so no header is needed in front of the block
+        const std::size_t size = malloc_usable_size(ptr);
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+        // Sequentially consistent with the phase opening, so a phase either sees this allocation at its start or
+        // in its mark
+        const std::size_t live = liveBytes.fetch_add(size) + size;
+        for (std::uint64_t open = openPhases.load(); open != 0; open &= open - 1)
+            raisePeak(phasePeaks[__builtin_ctzll(open)], live);
+        return ptr;
+    }
+
+    void release(void *ptr) noexcept {
+        if (!ptr)
+            return;
+        liveBytes.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+        std::free(ptr);
+    }
+#endif
+}
+
+#ifdef QASMPARSER_MEMORY_ACCOUNTING
+// Replacements of the global allocation functions; array, nothrow and sized forms forward to these
+void *operator new(const std::size_t size) {
+    return counted(std::malloc(std::max<std::size_t>(size, 1)));
+}
+
+void *operator new(const std::size_t size, const std::align_val_t align) {
+    // aligned_alloc takes multiples of the alignment only
+    const auto alignment = static_cast<std::size_t>(align);
+    const std::size_t rounded = (std::max<std::size_t>(size, 1) + alignment - 1) / alignment * alignment;
+    return counted(std::aligned_alloc(alignment, rounded));
+}
+
+void operator delete(void *ptr) noexcept {
+    release(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+    release(ptr);
+}
+#endif
+
+bool qasmparser::memoryAccounting() {
+#ifdef QASMPARSER_MEMORY_ACCOUNTING
+    return true;
+#else
+    return false;
+#endif
+}
+
+qasmparser::MemoryPhase::MemoryPhase()
+        : allocations(allocationCount.load(std::memory_order_relaxed)),
+          bytes(allocatedBytes.load(std::memory_order_relaxed)),
+          slot(-1) {
+    // Claim a free slot, the mark starts at the live bytes read after the claim
+    std::uint64_t open = openPhases.load();
+    while (~open != 0) {
+        const int free = __builtin_ctzll(~open);
+        if (openPhases.compare_exchange_weak(open, open | (std::uint64_t(1) << free))) {
+            slot = free;
+            break;
+        }
+    }
+    live = liveBytes.load();
+    if (slot >= 0)
+        phasePeaks[slot].store(live, std::memory_order_relaxed);
+}
+
+qasmparser::MemoryPhase::~MemoryPhase() {
+    if (slot >= 0)
+        openPhases.fetch_and(~(std::uint64_t(1) << slot));
+}
+
+qasmparser::MemoryUsage qasmparser::MemoryPhase::finish() const {
+    const std::size_t end = liveBytes.load(std::memory_order_relaxed);
+    const std::size_t peak = slot >= 0 ? phasePeaks[slot].load(std::memory_order_relaxed) : end;
+
+    MemoryUsage usage;
+    usage.allocations = allocationCount.load(std::memory_order_relaxed) - allocations;
+    usage.bytes = allocatedBytes.load(std::memory_order_relaxed) - bytes;
+    usage.peakBytes = std::max(peak, end) > live ? std::max(peak, end) - live : 0;
+    usage.retainedBytes = static_cast<std::ptrdiff_t>(end) - static_cast<std::ptrdiff_t>(live);
+    return usage;
+}
+
+void qasmparser::reportMemory(const std::size_t terms,
+                              const std::vector<std::pair<const char *, MemoryUsage> > &phases) {
+    const char *path = std::getenv("QASMPARSER_MEMORY_REPORT");
+    if (!memoryAccounting() || !path)
+        return;
+
+    std::string line = fmt::format("{{\"terms\":{},\"phases\":{{", terms);
+    for (std::size_t i = 0; i < phases.size(); i++) {
+        const auto &[name, usage] = phases[i];
+        fmt::format_to(std::back_inserter(line),
+                       "{}\"{}\":{{\"allocations\":{},\"bytes\":{},\"peak_bytes\":{},\"retained_bytes\":{}}}",
+                       i == 0 ? "" : ",", name, usage.allocations, usage.bytes, usage.peakBytes, usage.retainedBytes);
+    }
+    line += "}}\n";
+
+    std::lock_guard<std::mutex> guard(reportMtx);
+    std::ofstream report(path, std::ios::app);
+    report << line;
+}
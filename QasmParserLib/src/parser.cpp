@@ -3,18 +3,45 @@
 //
 
 #include "parser.h"
+#include "probes.h"
+#include "thread_pool.h"
 #include "fmt/core.h"
 
-#include <omp.h>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
 #include <fstream>
-#include <iostream>
+#include <limits>
+#include <stdexcept>
 #include <string>
 #include <algorithm>
 #include <execution>
-#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 
 
-void qasmparser::Parser::errorCheck(std::string& str, float& coef, unsigned long& param) const {
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @return Seconds passed since `start`
+     */
+    double secondsSince(const Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    /**
+     * @return CPU time consumed by all threads of the process, in seconds
+     */
+    double processCpuSeconds() {
+        timespec time{};
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+        return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_nsec) * 1e-9;
+    }
+}
+
+void qasmparser::Parser::errorCheck(std::string& str, double& coef, unsigned long& param) const {
     if (str.empty())
         throw std::invalid_argument("No operator provided!");
     else if (str.length() != numberQubits)
@@ -27,28 +54,31 @@ void qasmparser::Parser::errorCheck(std::string& str, float& coef, unsigned long
         throw std::invalid_argument("Parameter out of bound!");
 }
 
-void qasmparser::Parser::printError(const std::string &errMessage, unsigned long &idx) {
-    std::cerr << "Error! At line " << idx << std::endl;
-    std::cerr << errMessage << std::endl;
-    std::exit(EXIT_FAILURE);
+void qasmparser::Parser::lineError(const std::string &errMessage, const unsigned long idx) {
+    throw std::invalid_argument(fmt::format("Error! At line {}: {}", idx, errMessage));
 }
 
-void qasmparser::Parser::readLines(const std::string& filename) {
+void qasmparser::Parser::readLines(const std::string& filename, const CancellationToken &cancel) {
     std::ifstream inFile(filename);
 
     if (inFile.is_open()){
         std::string line;
         unsigned long lineIdx = 0;
+        std::unordered_set<unsigned long> seenParameters;  // Keeps `parameterIndices` unique in constant time
 
         while (getline(inFile, line)){
             lineIdx += 1;
+            inputBytes += line.size() + 1;
+            if (lineIdx % checkInterval == 0)
+                cancel.check();
+
             Parser::QuantumOperator qop;
-            std::string strRep; float coef; unsigned long param;  // Operator parameters
+            std::string strRep; double coef; unsigned long param;  // Operator parameters
 
             std::istringstream is (line);
             if (!(is >> strRep >> coef >> param)){
                 inFile.close();
-                printError(std::string("Wrong format!"), lineIdx);
+                lineError(std::string("Wrong format!"), lineIdx);
             }
 
             // Set number of qubits corresponding to qubits in first operator (must be equal for all operators)
@@ -59,19 +89,18 @@ void qasmparser::Parser::readLines(const std::string& filename) {
             try {errorCheck(strRep, coef, param);}
             catch (const std::invalid_argument& strException) {
                 inFile.close();
-                printError(strException.what(), lineIdx);
+                lineError(strException.what(), lineIdx);
             }
             catch (...) {
                 inFile.close();
-                printError(std::string("Unknown Error!"), lineIdx);
+                lineError(std::string("Unknown Error!"), lineIdx);
             }
 
             // Set independent parameter if provided is 0
             if (param == 0)
                 param = lineIdx;
 
-            auto it = std::find(parameterIndices.begin(), parameterIndices.end(), param);
-            if (it == parameterIndices.end())
+            if (seenParameters.insert(param).second)
                 parameterIndices.emplace_back(param);
 
             // Store each line in QuantumOperator struct and push into operators vector
@@ -116,184 +145,713 @@ std::vector< std::vector<unsigned long> > qasmparser::Parser::parseStrInt(std::s
     return intRep;
 }
 
-std::string qasmparser::Parser::parseOpToQasm(QuantumOperator& qop) {
-    // Parameterised rotation in Z basis. By definition this rotation is done on the last used qubit of the operator
-    const auto lastUsed = std::max(
-            {qop.intOp[0].empty() ? 0 : *std::max_element(qop.intOp[0].begin(), qop.intOp[0].end()),
-             qop.intOp[1].empty() ? 0 : *std::max_element(qop.intOp[1].begin(), qop.intOp[1].end()),
-             qop.intOp[2].empty() ? 0 : *std::max_element(qop.intOp[2].begin(), qop.intOp[2].end())}
-    );
+qasmparser::Parser::Ladder qasmparser::Parser::ladder(const QuantumOperator &qop) {
+    const auto& xVec = qop.intOp[0];
+    const auto& yVec = qop.intOp[1];
+    const auto& zVec = qop.intOp[2];
+
+    // Parameterised rotation in Z basis. By definition this rotation is done on the last used qubit of the operator.
+    // Indices are stored in ascending order, so the last used qubit is the back of one of the vectors.
+    Ladder l{};
+    l.lastUsed = std::max({xVec.empty() ? 0 : xVec.back(),
+                           yVec.empty() ? 0 : yVec.back(),
+                           zVec.empty() ? 0 : zVec.back()});
+    l.lastX = !xVec.empty() && xVec.back() == l.lastUsed;
+    l.lastY = !yVec.empty() && yVec.back() == l.lastUsed;
+
+    // The last used qubit needs no CNOT
+    l.xCount = xVec.size() - l.lastX;
+    l.yCount = yVec.size() - l.lastY;
+    l.zCount = zVec.size() - (!zVec.empty() && zVec.back() == l.lastUsed);
+    return l;
+}
 
-    // No active qubits in operator
-    if (lastUsed == 0)
-        return "";
-
-    std::string qasmOp, beforeLast, afterLast;
-    if (Parser::parameterize)
-        qasmOp = fmt::format("rz({}{}*param{}) q[{}];\n", mup, qop.coef, qop.param, lastUsed - 1);
-    else
-        qasmOp = fmt::format("rz({}{}) q[{}];\n", mup, qop.coef, lastUsed - 1);
-
-    // Go through vector entries indicating pauli matrix on qubits at these indices and therefore rotations in
-    // corresponding basis. First vector corresponds to Pauli-X, second to Pauli-Y, third and last to Pauli-Z.
-    for (const auto& vec : qop.intOp) {
-        switch (std::distance(qop.intOp.begin(), std::find(qop.intOp.begin(), qop.intOp.end(), vec))) {
-            case 0:
-                for (auto qubitIdx: vec) {
-                    std::string before = fmt::format("ry(pi/2) q[{}];\n", qubitIdx - 1);
-                    std::string after = fmt::format("ry(-pi/2) q[{}];\n", qubitIdx - 1);
-
-                    if (qubitIdx == lastUsed) {
-                        beforeLast = before;
-                        afterLast = after;
-                        continue;
-                    }
-
-                    before += fmt::format("cx q[{}], q[{}];\n", qubitIdx - 1, lastUsed - 1);
-                    after.insert(0, fmt::format("cx q[{}], q[{}];\n", qubitIdx - 1, lastUsed - 1));
-
-                    qasmOp.insert(0, before);
-                    qasmOp += after;
-                }
-                break;
+void qasmparser::Parser::parseLadderToQasm(const QuantumOperator &qop, const Ladder &l, const bool before,
+                                           const std::size_t from, const std::size_t to, std::string &qasmOp) {
+    const auto& xVec = qop.intOp[0];
+    const auto& yVec = qop.intOp[1];
+    const auto& zVec = qop.intOp[2];
+    const auto last = l.lastUsed - 1;
+    auto out = std::back_inserter(qasmOp);
+
+    // Emit the part of a segment of `count` rungs starting at ladder position `begin` that lies in [from, to)
+    auto segment = [from, to](const std::size_t begin, const std::size_t count, const auto &rung) {
+        for (std::size_t i = std::max(from, begin); i < std::min(to, begin + count); i++)
+            rung(i - begin);
+    };
+
+    if (before) {
+        // Basis changes and CNOT ladder in front of the rotation, Pauli-Z down to Pauli-X and descending in qubits
+        segment(0, l.zCount, [&](const std::size_t i) {
+            fmt::format_to(out, "cx q[{0}], q[{1}];\n", zVec[l.zCount - 1 - i] - 1, last);
+        });
+        segment(l.zCount, l.yCount, [&](const std::size_t i) {
+            // Rotation in x basis by -0.5 pi before and +0.5 pi afterward
+            fmt::format_to(out, "rx(-pi/2) q[{0}];\ncx q[{0}], q[{1}];\n", yVec[l.yCount - 1 - i] - 1, last);
+        });
+        segment(l.zCount + l.yCount, l.xCount, [&](const std::size_t i) {
+            fmt::format_to(out, "ry(pi/2) q[{0}];\ncx q[{0}], q[{1}];\n", xVec[l.xCount - 1 - i] - 1, last);
+        });
+    } else {
+        // Mirrored CNOT ladder and basis changes behind the rotation
+        segment(0, l.xCount, [&](const std::size_t i) {
+            fmt::format_to(out, "cx q[{0}], q[{1}];\nry(-pi/2) q[{0}];\n", xVec[i] - 1, last);
+        });
+        segment(l.xCount, l.yCount, [&](const std::size_t i) {
+            fmt::format_to(out, "cx q[{0}], q[{1}];\nrx(pi/2) q[{0}];\n", yVec[i] - 1, last);
+        });
+        segment(l.xCount + l.yCount, l.zCount, [&](const std::size_t i) {
+            fmt::format_to(out, "cx q[{0}], q[{1}];\n", zVec[i] - 1, last);
+        });
+    }
+}
 
-            case 1:
-                for (auto qubitIdx: vec) {
-                    // Rotation in x basis by -0.5 pi before and +0.5 pi afterward
-                    std::string before = fmt::format("rx(-pi/2) q[{}];\n", qubitIdx - 1);
-                    std::string after = fmt::format("rx(pi/2) q[{}];\n", qubitIdx - 1);
-
-                    if (qubitIdx == lastUsed) {
-                        afterLast = after;
-                        beforeLast = before;
-                        continue;
-                    }
-                    // If operation is performed on last qubit used by operator, no CNOTs are needed
-                    before += fmt::format("cx q[{}], q[{}];\n", qubitIdx - 1, lastUsed - 1);
-                    after.insert(0, fmt::format("cx q[{}], q[{}];\n", qubitIdx - 1, lastUsed - 1));
-
-                    qasmOp.insert(0, before);
-                    qasmOp += after;
-                }
-                break;
+std::size_t qasmparser::Parser::parseOpToQasm(const QuantumOperator& qop, const std::string& angle,
+                                              std::string& qasmOp, const Backend backend) {
+    const Ladder l = ladder(qop);
 
-            case 2:
-                for (auto qubitIdx: vec) {
-                    // Z vector, indicating Pauli Z operations. No rotation since we are in Z basis already
-                    if (qubitIdx != lastUsed) {
-                        std::string before = fmt::format("cx q[{}], q[{}];\n", qubitIdx - 1, lastUsed - 1);
-                        std::string after = fmt::format("cx q[{}], q[{}];\n", qubitIdx - 1, lastUsed - 1);
+    // No active qubits in operator
+    if (l.lastUsed == 0)
+        return std::string::npos;
+
+    const auto last = l.lastUsed - 1;
+    const std::size_t rungs = l.xCount + l.yCount + l.zCount;
+    auto out = std::back_inserter(qasmOp);
+
+    fmt::format_to(out, "\n// New operator from line {}\n", qop.index);
+
+    // Basis change of the last used qubit comes first, it needs no CNOT
+    if (l.lastX)
+        fmt::format_to(out, "ry(pi/2) q[{}];\n", last);
+    else if (l.lastY)
+        fmt::format_to(out, "rx(-pi/2) q[{}];\n", last);
+
+    // Ladders of very heavy operators are emitted in parts by nested tasks and stitched together in order
+    std::vector<std::string> afterParts;
+    if (backend != Backend::Sequential && rungs >= splitWeight) {
+        const std::size_t parts = (rungs + splitRungs - 1) / splitRungs;
+        std::vector<std::string> beforeParts(parts);
+        afterParts.resize(parts);
+
+        threadPool()->nested(backend, parts, [&](const std::size_t part) {
+            const std::size_t from = part * splitRungs, to = std::min(from + splitRungs, rungs);
+            parseLadderToQasm(qop, l, true, from, to, beforeParts[part]);
+            parseLadderToQasm(qop, l, false, from, to, afterParts[part]);
+        });
+
+        for (const auto &part : beforeParts)
+            qasmOp += part;
+    } else {
+        parseLadderToQasm(qop, l, true, 0, rungs, qasmOp);
+    }
 
-                        qasmOp.insert(0, before);
-                        qasmOp += after;
-                    }
-                }
-                break;
+    qasmOp += "rz(";
+    const std::size_t angleOffset = qasmOp.size();
+    qasmOp += angle;
+    fmt::format_to(out, ") q[{}];\n", last);
 
-            default:
-                // To many vectors, therefore to many pauli operations, only 3 possible (Pauli-X, Pauli-Y, Pauli-Z)
-                std::exit(EXIT_FAILURE);
-        }
+    if (afterParts.empty()) {
+        parseLadderToQasm(qop, l, false, 0, rungs, qasmOp);
+    } else {
+        for (const auto &part : afterParts)
+            qasmOp += part;
     }
-    qasmOp.insert(0, beforeLast);
-    qasmOp += afterLast;
 
-    return qasmOp.insert(0, fmt::format("\n// New operator from line {}\n", qop.index));
+    if (l.lastX)
+        fmt::format_to(out, "ry(-pi/2) q[{}];\n", last);
+    else if (l.lastY)
+        fmt::format_to(out, "rx(pi/2) q[{}];\n", last);
+
+    return angleOffset;
 }
 
-std::string qasmparser::Parser::inputParamQasmVariable(std::vector<unsigned long>& paramNames) {
+std::string qasmparser::Parser::qasmHeader(const int version) const {
+    // OpenQASM version specific header
+    if (version == 3) {
+        return fmt::format("OPENQASM 3.0;\n"
+                           "include \"stdgates.inc\";\n"
+                           "qubit[{0}] q;\n"  // Qubit register of size `numberQubits`
+                           "bit[{0}] c;\n",   // Classical bit register of same size
+                           numberQubits);
+    }
+    return fmt::format("OPENQASM 2.0;\n"
+                       "include \"qelib1.inc\";\n"
+                       "qreg q[{0}];\n"   // Qubit register of size `numberQubits`
+                       "creg c[{0}];\n",  // Classical bit register of same size
+                       numberQubits);
+}
+
+std::string qasmparser::Parser::inputParamQasmVariable(const std::vector<unsigned long>& paramNames) {
     std::string paramQasm;
     for (auto paramName: paramNames)
         paramQasm += fmt::format("input float param{};\n", paramName);
     return paramQasm;
 }
 
-std::string qasmparser::parseCircuit(const std::string &inFilename,
-                                     const int version,
-                                     const bool useOpenMP,
-                                     const bool parameterize,
-                                     const std::optional<std::string> &outFilename,
-                                     const std::optional<float> &multiplier) {
-    Parser p;
-    std::map<unsigned long, std::string> qasmOperators;
-    std::string qasm;
-
-    p.parameterize = parameterize;
-    if (multiplier.has_value())
-        p.mup = std::to_string(multiplier.value()) + "*";
-
-    std::mutex parseOpMtx;
+void qasmparser::Parser::convertOperators(const Backend backend, const CancellationToken &cancel) {
+    // Failing operators keep their string representation and are reported after the loop, so the error is the one of
+    // the first failing line independent of the thread schedule
+    auto convert = [&cancel](QuantumOperator &op) {
+        if (cancel.expired())
+            return;
+        try {
+            op.intOp = parseStrInt(op.strRep);
+            std::string().swap(op.strRep);
+        }
+        catch (const std::invalid_argument &) {}
+    };
 
-    // Read lines into `operators` vector
-    p.readLines(inFilename);
+    // Conversion cost is the same for all operators, proportional to the number of qubits
+    const auto pool = threadPool();
+    conversion = pool->schedule(backend, operators.size(), operators.size() * numberQubits, numberQubits);
+    pool->forEach(conversion, operators.begin(), operators.end(), convert, "convert operators");
+    cancel.check();
 
-    if (useOpenMP) {
-        #pragma omp parallel for default(none) shared(p, version, qasmOperators)
-        for (auto &op: p.operators) {
+    for (auto &op : operators) {
+        if (op.intOp.empty()) {
             try {
-                op.intOp = p.parseStrInt(op.strRep);
+                parseStrInt(op.strRep);
             }
             catch (const std::invalid_argument &exception) {
-                #pragma omp critical (print)
-                p.printError(exception.what(), op.index);
+                lineError(exception.what(), op.index);
             }
-
-            std::string qasmOp;
-            qasmOp = p.parseOpToQasm(op);
-            #pragma omp critical (qasmOperator)
-            qasmOperators[op.index] = qasmOp;
         }
-    } else {
-        // For each operator: parse string into integer representation, parse into OpenQASM, and store in `qasmOperators`
-        std::for_each(std::execution::par, p.operators.begin(), p.operators.end(),
-                      [&](Parser::QuantumOperator op) {
-                          try {
-                              op.intOp = p.parseStrInt(op.strRep);
-                          }
-                          catch (const std::invalid_argument &exception) {
-                              p.printError(exception.what(), op.index);
-                          }
-
-                          std::string qasmOp;
-                          qasmOp = p.parseOpToQasm(op);
-
-                          std::lock_guard<std::mutex> guard(parseOpMtx);
-                          qasmOperators[op.index] = qasmOp;
-                      });
+        const std::size_t weight = pauliWeight(op);
+        totalWeight += weight;
+        maxWeight = std::max(maxWeight, weight);
     }
+}
 
-    // OpenQASM version specific header
-    if (version == 3) {
-        qasm += fmt::format("OPENQASM 3.0;\n"
-                            "include \"stdgates.inc\";\n"
-                            "qubit[{0}] q;\n"  // Qubit register of size `numberQubits`
-                            "bit[{0}] c;\n",   // Classical bit register of same size
-                            p.numberQubits);
+qasmparser::Parser::Parser(const std::string &inFilename, const Backend backend, const CancellationToken &cancel) {
+    // Read lines into `operators` vector and convert them into integer representation
+    auto start = Clock::now();
+    {
+        const TraceSpan span("read");
+        const MemoryPhase memory;
+        const CounterPhase counters;
+        QASMPARSER_PROBE1(read_start, inFilename.c_str());
+        readLines(inFilename, cancel);
+        QASMPARSER_PROBE2(read_done, operators.size(), inputBytes);
+        readMemory = memory.finish();
+        readCounters = counters.finish();
+    }
+    readSeconds = secondsSince(start);
+
+    start = Clock::now();
+    const double cpu = processCpuSeconds();
+    {
+        const TraceSpan span("convert", operators.size());
+        const MemoryPhase memory;
+        const CounterPhase counters;
+        QASMPARSER_PROBE1(convert_start, operators.size());
+        convertOperators(backend, cancel);
+        QASMPARSER_PROBE1(convert_done, operators.size());
+        convertMemory = memory.finish();
+        convertCounters = counters.finish();
     }
-    else {
-        qasm += fmt::format("OPENQASM 2.0;\n"
-                            "include \"qelib1.inc\";\n"
-                            "qreg q[{0}];\n"   // Qubit register of size `numberQubits`
-                            "creg c[{0}];\n",  // Classical bit register of same size
-                            p.numberQubits);
+    convertSeconds = secondsSince(start);
+    convertCpuSeconds = processCpuSeconds() - cpu;
+}
+
+std::vector<qasmparser::Parser::QasmFragment>
+qasmparser::Parser::parseOperators(const Backend backend,
+                                   const std::function<std::string(const QuantumOperator &)> &angle,
+                                   const std::size_t first, const std::size_t last,
+                                   const CancellationToken &cancel) const {
+    // One preallocated slot per operator, each written by exactly one thread, no locking needed
+    std::vector<QasmFragment> qasmOperators(last - first);
+
+    // Emission cost is proportional to the Pauli weight, heavy operators are scheduled first
+    std::vector<std::size_t> costs(last - first);
+    std::size_t work = 0, maxWork = 0;
+    for (std::size_t i = 0; i < costs.size(); i++) {
+        costs[i] = pauliWeight(operators[first + i]) + 1;
+        work += costs[i];
+        maxWork = std::max(maxWork, costs[i]);
     }
 
+    // For each operator: parse into OpenQASM, and store in its slot of `qasmOperators`
+    const auto pool = threadPool();
+    const Schedule emission = pool->schedule(backend, costs.size(), work, maxWork);
+    // Auto runs a loop over one or a few heavy operators sequentially, their ladders still split on the pool
+    const Backend ladders = backend == Backend::Auto && emission.backend == Backend::Sequential && pool->size() > 1
+            ? Backend::ExecutionPolicy : emission.backend;
+    pool->forEachWeighted(emission, costs, [&](const std::size_t i) {
+        // Once cancelled the remaining operators are skipped, their slots stay empty
+        if (cancel.expired())
+            return;
+        const auto &op = operators[first + i];
+        qasmOperators[i].angleOffset = parseOpToQasm(op, angle(op), qasmOperators[i].qasm, ladders);
+    }, "emit operators");
+    cancel.check();
+    return qasmOperators;
+}
+
+qasmparser::Schedule qasmparser::Parser::schedule(const Backend backend) const {
+    // Emission cost of an operator is proportional to its Pauli weight, plus its comment and rotation
+    std::vector<std::size_t> costs(operators.size());
+    for (std::size_t i = 0; i < costs.size(); i++)
+        costs[i] = pauliWeight(operators[i]) + 1;
+    const auto pool = threadPool();
+    return pool->weighted(pool->schedule(backend, operators.size(), totalWeight + operators.size(), maxWeight + 1),
+                          costs);
+}
+
+void qasmparser::Parser::assemble(std::string &qasm, const std::vector<QasmFragment> &fragments) {
+    std::size_t size = qasm.size();
+    for (const auto &fragment : fragments)
+        size += fragment.qasm.size();
+    qasm.reserve(size);
+
+    for (const auto &fragment : fragments)
+        qasm += fragment.qasm;
+}
+
+std::function<std::string(const qasmparser::Parser::QuantumOperator &)>
+qasmparser::Parser::emission(const int version,
+                             const bool parameterize,
+                             const std::optional<double> &multiplier,
+                             const CoefficientInputs coefficientInputs,
+                             std::string &preamble) const {
+    const double mup = multiplier.value_or(2);
+
+    // Runtime inputs are only supported by version 3
+    std::vector<std::pair<unsigned long, double> > coefInputs;
+    auto coefIds = coefficientIds(version == 3 ? coefficientInputs : CoefficientInputs::Off, coefInputs);
+
+    preamble = qasmHeader(version);
+
     // Add parameterization variables to the qasm output
-    if (p.parameterize)
-        qasm += p.inputParamQasmVariable(p.parameterIndices);
+    if (parameterize)
+        preamble += inputParamQasmVariable(parameterIndices);
+
+    // Add runtime coefficient variables to the qasm output
+    for (const auto &[coefId, value] : coefInputs)
+        preamble += fmt::format("input float coef{};\n", coefId);
+
+    const bool withInputs = !coefInputs.empty();
+    return [this, mup, parameterize, withInputs, coefIds = std::move(coefIds)](const QuantumOperator &op) {
+        if (!withInputs)
+            return parameterize ? fmt::format("{}*param{}", mup * op.coef, op.param)
+                                : fmt::format("{}", mup * op.coef);
+
+        const auto coefId = coefIds[&op - operators.data()];
+        return parameterize ? fmt::format("{}*coef{}*param{}", mup, coefId, op.param)
+                            : fmt::format("{}*coef{}", mup, coefId);
+    };
+}
 
-    for (const auto& [idx, op] : qasmOperators)
-        qasm += op;
+std::string qasmparser::Parser::emit(const int version,
+                                     const Backend backend,
+                                     const bool parameterize,
+                                     const std::optional<std::string> &outFilename,
+                                     const std::optional<double> &multiplier,
+                                     const CoefficientInputs coefficientInputs,
+                                     const CancellationToken &cancel,
+                                     CompileStats *stats) const {
+    auto start = Clock::now();
+    const double cpu = processCpuSeconds();
+    std::string qasm;
+    std::vector<QasmFragment> qasmOperators;
+    MemoryUsage emitMemory, assembleMemory;
+    HardwareCounters emitCounters, assembleCounters;
+    {
+        const TraceSpan span("emit", operators.size());
+        const MemoryPhase memory;
+        const CounterPhase counters;
+        QASMPARSER_PROBE1(emit_start, operators.size());
+        const auto angle = emission(version, parameterize, multiplier, coefficientInputs, qasm);
+        qasmOperators = parseOperators(backend, angle, 0, operators.size(), cancel);
+        QASMPARSER_PROBE1(emit_done, operators.size());
+        emitMemory = memory.finish();
+        emitCounters = counters.finish();
+    }
+    const double emitSeconds = secondsSince(start);
+    const double emitCpuSeconds = processCpuSeconds() - cpu;
+
+    start = Clock::now();
+    {
+        const TraceSpan span("assemble", qasmOperators.size());
+        const MemoryPhase memory;
+        const CounterPhase counters;
+        QASMPARSER_PROBE1(assemble_start, qasmOperators.size());
+        assemble(qasm, qasmOperators);
+        QASMPARSER_PROBE1(assemble_done, qasm.size());
+        assembleMemory = memory.finish();
+        assembleCounters = counters.finish();
+    }
+    const double assembleSeconds = secondsSince(start);
+    reportMemory(operators.size(), {{"read", readMemory}, {"convert", convertMemory}, {"emit", emitMemory},
+                                    {"assemble", assembleMemory}});
 
     // Write out OpenQASM representations of operators stored in `qasmOperators`
-    if (!outFilename)
-        return qasm;
+    start = Clock::now();
+    if (outFilename) {
+        const TraceSpan span("write");
+        QASMPARSER_PROBE1(write_start, outFilename->c_str());
+        std::ofstream outFile (outFilename.value());
+        if (outFile.is_open()) {
+            outFile << qasm;
+            outFile.close();
+        }
+        QASMPARSER_PROBE1(write_done, qasm.size());
+    }
 
-    std::ofstream outFile (outFilename.value());
-    if (outFile.is_open()) {
-        outFile << qasm;
-        outFile.close();
+    if (stats) {
+        *stats = statistics();
+        stats->emitSeconds = emitSeconds;
+        stats->assembleSeconds = assembleSeconds;
+        stats->writeSeconds = outFilename ? secondsSince(start) : 0;
+        stats->bytesOut = qasm.size();
+        stats->emitMemory = emitMemory;
+        stats->assembleMemory = assembleMemory;
+        stats->emitCounters = emitCounters;
+        stats->assembleCounters = assembleCounters;
+
+        const double busy = (convertSeconds + emitSeconds) * static_cast<double>(stats->threads);
+        stats->utilization = busy > 0 ? (convertCpuSeconds + emitCpuSeconds) / busy : 0;
     }
+    return qasm;
+}
+
+qasmparser::CompileStats qasmparser::Parser::statistics() const {
+    CompileStats stats;
+    stats.readSeconds = readSeconds;
+    stats.convertSeconds = convertSeconds;
+    stats.readMemory = readMemory;
+    stats.convertMemory = convertMemory;
+    stats.readCounters = readCounters;
+    stats.convertCounters = convertCounters;
+    stats.bytesIn = inputBytes;
+    stats.terms = operators.size();
+    stats.parameters = parameterIndices.size();
+    stats.threads = threadPool()->size();
+
+    // Every active operator has one rotation, two CNOTs per further active qubit and two basis changes per X or Y
+    for (const auto &op : operators) {
+        const std::size_t weight = pauliWeight(op);
+        if (weight == 0)
+            continue;
+        stats.rzGates += 1;
+        stats.cxGates += 2 * (weight - 1);
+        stats.ryGates += 2 * op.intOp[0].size();
+        stats.rxGates += 2 * op.intOp[1].size();
+    }
+    return stats;
+}
+
+std::vector<unsigned long> qasmparser::Parser::coefficientIds(const CoefficientInputs mode,
+                                                              std::vector<std::pair<unsigned long, double> > &inputs) const {
+    std::vector<unsigned long> ids(operators.size(), 0);
+    if (mode == CoefficientInputs::Off)
+        return ids;
+
+    // Inputs are numbered by line for PerTerm and consecutively from 1 for PerValue
+    std::unordered_map<double, unsigned long> valueIds;
+    for (std::size_t i = 0; i < operators.size(); i++) {
+        const auto &op = operators[i];
+        if (op.intOp[0].empty() && op.intOp[1].empty() && op.intOp[2].empty())
+            continue;
+
+        if (mode == CoefficientInputs::PerTerm) {
+            ids[i] = op.index;
+            inputs.emplace_back(op.index, op.coef);
+            continue;
+        }
+
+        const auto [it, inserted] = valueIds.try_emplace(op.coef, valueIds.size() + 1);
+        if (inserted)
+            inputs.emplace_back(it->second, op.coef);
+        ids[i] = it->second;
+    }
+    return ids;
+}
+
+std::vector<std::pair<std::string, double> >
+qasmparser::Parser::coefficientInputValues(const CoefficientInputs mode) const {
+    std::vector<std::pair<unsigned long, double> > inputs;
+    coefficientIds(mode, inputs);
+
+    std::vector<std::pair<std::string, double> > values;
+    values.reserve(inputs.size());
+    for (const auto &[coefId, value] : inputs)
+        values.emplace_back(fmt::format("coef{}", coefId), value);
+    return values;
+}
+
+qasmparser::CircuitTemplate qasmparser::Parser::compileTemplate(const int version,
+                                                                const Backend backend,
+                                                                const std::optional<double> &multiplier) const {
+    const double mup = multiplier.value_or(2);
+    CircuitTemplate tmpl;
+    tmpl.parameterIndices = parameterIndices;
+
+    // Position of each parameter in the value vector handed to `bind`
+    std::unordered_map<unsigned long, std::size_t> paramPosition;
+    for (std::size_t i = 0; i < parameterIndices.size(); i++)
+        paramPosition.emplace(parameterIndices[i], i);
+
+    // Angles are left out of the fragments, only their offsets are recorded
+    const auto qasmOperators = parseOperators(backend, [](const QuantumOperator &) { return std::string(); },
+                                              0, operators.size());
+
+    tmpl.text = qasmHeader(version);
+    tmpl.slots.reserve(operators.size());
+    for (std::size_t i = 0; i < operators.size(); i++) {
+        const auto &op = operators[i];
+        const auto &fragment = qasmOperators[i];
+        if (fragment.angleOffset != std::string::npos)
+            tmpl.slots.push_back({tmpl.text.size() + fragment.angleOffset, mup * op.coef, paramPosition.at(op.param)});
+        tmpl.text += fragment.qasm;
+    }
+    return tmpl;
+}
 
+std::string qasmparser::CircuitTemplate::bind(const std::vector<double> &values) const {
+    if (values.size() != parameterIndices.size())
+        throw std::invalid_argument(fmt::format("Expected {} parameter values, got {}!",
+                                                parameterIndices.size(), values.size()));
+
+    std::string qasm;
+    qasm.reserve(text.size() + slots.size() * maxAngleLength);
+
+    // Single pass: copy the text up to the next slot, then format the bound angle into it
+    std::size_t pos = 0;
+    char angle[maxAngleLength];
+    for (const auto &slot : slots) {
+        qasm.append(text, pos, slot.offset - pos);
+        qasm.append(angle, fmt::format_to(angle, "{}", slot.angle * values[slot.param]));
+        pos = slot.offset;
+    }
+    qasm.append(text, pos, std::string::npos);
     return qasm;
 }
+
+void qasmparser::CircuitTemplate::checkRows(const std::vector<std::vector<double> > &values) const {
+    // `bind` must not throw inside the parallel regions
+    for (std::size_t row = 0; row < values.size(); row++) {
+        if (values[row].size() != parameterIndices.size())
+            throw std::invalid_argument(fmt::format("Expected {} parameter values in row {}, got {}!",
+                                                    parameterIndices.size(), row, values[row].size()));
+    }
+}
+
+std::vector<std::string> qasmparser::CircuitTemplate::bindBatch(const std::vector<std::vector<double> > &values,
+                                                                const Backend backend) const {
+    checkRows(values);
+    std::vector<std::string> circuits(values.size());
+
+    const auto pool = threadPool();
+    pool->forEach(pool->schedule(backend, values.size(), values.size() * rowWork(), rowWork()),
+                  circuits.begin(), circuits.end(), [&](std::string &qasm) {
+                      qasm = bind(values[&qasm - circuits.data()]);
+                  }, "bind rows");
+    return circuits;
+}
+
+std::vector<std::string> qasmparser::CircuitTemplate::bindBatchToFiles(const std::vector<std::vector<double> > &values,
+                                                                       const std::string &directory,
+                                                                       const Backend backend,
+                                                                       const std::size_t shardSize) const {
+    checkRows(values);
+    std::vector<std::string> paths(values.size());
+
+    // Create directories up front, workers only write files
+    for (std::size_t row = 0; row < values.size(); row++) {
+        std::filesystem::path dir(directory);
+        if (shardSize != 0)
+            dir /= fmt::format("shard_{}", row / shardSize);
+        if (row == 0 || (shardSize != 0 && row % shardSize == 0))
+            std::filesystem::create_directories(dir);
+        paths[row] = (dir / fmt::format("circuit_{}.qasm", row)).string();
+    }
+
+    // Exceptions must not escape the parallel region, the first failed path is reported afterwards
+    std::vector<char> failed(values.size(), false);
+    const auto pool = threadPool();
+    pool->forEach(pool->schedule(backend, values.size(), values.size() * rowWork(), rowWork()),
+                  paths.begin(), paths.end(), [&](const std::string &path) {
+                      const auto row = &path - paths.data();
+                      const std::string qasm = bind(values[row]);
+                      std::ofstream outFile(path, std::ios::binary);
+                      outFile.write(qasm.data(), static_cast<std::streamsize>(qasm.size()));
+                      failed[row] = !outFile.good();
+                  }, "bind rows");
+
+    const auto firstFailed = std::find(failed.begin(), failed.end(), true);
+    if (firstFailed != failed.end())
+        throw std::runtime_error(fmt::format("Cannot write {}!", paths[firstFailed - failed.begin()]));
+    return paths;
+}
+
+qasmparser::CircuitStream::CircuitStream(std::shared_ptr<const Parser> parser,
+                                         const int version,
+                                         const Backend backend,
+                                         const bool parameterize,
+                                         const std::optional<double> &multiplier,
+                                         const CoefficientInputs coefficientInputs,
+                                         const std::size_t lookAhead,
+                                         const CancellationToken &cancel)
+        : state(std::make_shared<State>()) {
+    // A child token, so closing the stream does not cancel other compiles holding the caller's token
+    state->cancel = cancel.child();
+    std::string preamble;
+    auto angle = parser->emission(version, parameterize, multiplier, coefficientInputs, preamble);
+    state->chunks.push_back(std::move(preamble));
+
+    // The thread owns the parser and the state, so destroying the stream never leaves it dangling
+    producer = std::thread([state = state, parser = std::move(parser), angle = std::move(angle), backend,
+                            limit = std::max<std::size_t>(lookAhead, 1)]() {
+        try {
+            const auto &operators = parser->operators;
+            std::size_t first = 0;
+            while (first < operators.size()) {
+                // Cut the next window at operator boundaries once it reaches `windowWork` gates
+                std::size_t last = first, work = 0;
+                while (last < operators.size() && work < windowWork)
+                    work += Parser::pauliWeight(operators[last++]) + 1;
+
+                std::string chunk;
+                const auto fragments = parser->parseOperators(backend, angle, first, last, state->cancel);
+                {
+                    const TraceSpan span("assemble", fragments.size());
+                    Parser::assemble(chunk, fragments);
+                }
+                first = last;
+
+                std::unique_lock<std::mutex> lock(state->mtx);
+                state->changed.wait(lock, [&] { return state->stop || state->chunks.size() < limit; });
+                if (state->stop)
+                    break;
+                // The window may have finished just before the token expired while it waited for the consumer
+                state->cancel.check();
+                state->chunks.push_back(std::move(chunk));
+                state->changed.notify_all();
+            }
+        }
+        catch (...) {
+            // Once the consumer stopped the stream nobody reads the error, e.g. the `Cancelled` of its own stop
+            std::lock_guard<std::mutex> guard(state->mtx);
+            if (!state->stop)
+                state->error = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> guard(state->mtx);
+        state->done = true;
+        state->changed.notify_all();
+    });
+}
+
+qasmparser::CircuitStream::~CircuitStream() {
+    close();
+}
+
+void qasmparser::CircuitStream::close() {
+    if (!state || !producer.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> guard(state->mtx);
+        state->stop = true;
+        state->cancel.cancel();
+        state->chunks.clear();
+        state->changed.notify_all();
+    }
+    producer.join();
+
+    // Wake consumers waiting in `next` on other threads, also if the producer ended before the stop
+    std::lock_guard<std::mutex> guard(state->mtx);
+    state->done = true;
+    state->changed.notify_all();
+}
+
+std::optional<std::string> qasmparser::CircuitStream::next() {
+    std::unique_lock<std::mutex> lock(state->mtx);
+    state->changed.wait(lock, [&] { return !state->chunks.empty() || state->done; });
+
+    if (!state->chunks.empty()) {
+        std::string chunk = std::move(state->chunks.front());
+        state->chunks.pop_front();
+        state->changed.notify_all();
+        return chunk;
+    }
+    if (state->error)
+        std::rethrow_exception(std::exchange(state->error, nullptr));
+    return std::nullopt;
+}
+
+qasmparser::CircuitStream qasmparser::streamCircuit(const std::string &inFilename,
+                                                    const int version,
+                                                    const Backend backend,
+                                                    const bool parameterize,
+                                                    const std::optional<double> &multiplier,
+                                                    const CoefficientInputs coefficientInputs,
+                                                    const std::size_t lookAhead,
+                                                    const CancellationToken &cancel) {
+    return CircuitStream(std::make_shared<const Parser>(inFilename, backend, cancel), version, backend, parameterize,
+                         multiplier, coefficientInputs, lookAhead, cancel);
+}
+
+std::string qasmparser::parseCircuit(const std::string &inFilename,
+                                     const int version,
+                                     const Backend backend,
+                                     const bool parameterize,
+                                     const std::optional<std::string> &outFilename,
+                                     const std::optional<double> &multiplier,
+                                     const CoefficientInputs coefficientInputs,
+                                     const CancellationToken &cancel,
+                                     CompileStats *stats) {
+    const Parser p(inFilename, backend, cancel);
+    return p.emit(version, backend, parameterize, outFilename, multiplier, coefficientInputs, cancel, stats);
+}
+
+std::vector<std::string> qasmparser::parseCircuits(const std::vector<std::string> &inFilenames,
+                                                   const int version,
+                                                   const Backend backend,
+                                                   const bool parameterize,
+                                                   const std::vector<std::optional<std::string> > &outFilenames,
+                                                   const std::optional<double> &multiplier,
+                                                   const CoefficientInputs coefficientInputs,
+                                                   const CancellationToken &cancel) {
+    if (!outFilenames.empty() && outFilenames.size() != inFilenames.size())
+        throw std::invalid_argument(fmt::format("Expected {} output files, got {}!",
+                                                inFilenames.size(), outFilenames.size()));
+
+    // Cost of a file estimated by its size, about 16 bytes of input per emitted gate
+    std::vector<std::size_t> costs(inFilenames.size());
+    std::size_t total = 0, maxCost = 0;
+    for (std::size_t i = 0; i < inFilenames.size(); i++) {
+        std::error_code error;
+        const auto size = std::filesystem::file_size(inFilenames[i], error);
+        costs[i] = (error ? 0 : size / 16) + 1;
+        total += costs[i];
+        maxCost = std::max(maxCost, costs[i]);
+    }
+
+    // Loops within a file run on the framework of the loop over the files, so nested loops compose instead of
+    // oversubscribing the cores. A single or tiny batch leaves the files their own choice.
+    const auto pool = threadPool();
+    const Schedule files = pool->schedule(backend, inFilenames.size(), total, maxCost);
+    const Backend perFile = files.backend == Backend::Sequential ? backend : files.backend;
+
+    std::vector<std::string> circuits(inFilenames.size());
+    pool->forEachWeighted(files, costs, [&](const std::size_t i) {
+        if (cancel.expired())
+            return;
+        const Parser p(inFilenames[i], perFile, cancel);
+        circuits[i] = p.emit(version, perFile, parameterize, outFilenames.empty() ? std::nullopt : outFilenames[i],
+                             multiplier, coefficientInputs, cancel);
+    }, "compile files");
+    cancel.check();
+    return circuits;
+}
+
+std::string qasmparser::parseCircuit(const std::string &inFilename,
+                                     const int version,
+                                     const bool useOpenMP,
+                                     const bool parameterize,
+                                     const std::optional<std::string> &outFilename,
+                                     const std::optional<double> &multiplier,
+                                     const CoefficientInputs coefficientInputs) {
+    return parseCircuit(inFilename, version, useOpenMP ? Backend::OpenMP : Backend::ExecutionPolicy, parameterize,
+                        outFilename, multiplier, coefficientInputs);
+}
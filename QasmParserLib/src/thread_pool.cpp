@@ -0,0 +1,252 @@
+//
+// Persistent worker pool shared by the parallel loops of the parser.
+//
+
+#include "thread_pool.h"
+
+#include <tbb/task_scheduler_observer.h>
+#include <omp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+namespace {
+    constexpr std::size_t sequentialWork = 1 << 14;       // Below this many gates a parallel loop does not pay off
+    constexpr std::size_t chunkWork = 1 << 8;             // Minimal gates per chunk to outweigh scheduling a chunk
+    constexpr std::size_t chunksPerThread = 8;            // Chunks per thread, for load balancing
+    constexpr std::size_t skewFactor = 16;                // Heaviest element over mean considered skewed
+
+    std::size_t hardwareThreads() {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    thread_local bool pinnedThread = false;               // The calling thread was pinned by a pool
+
+    /**
+     * @return Affinity mask of the process before any pool pinned a thread
+     */
+    const cpu_set_t &processCpus() {
+        static const cpu_set_t cpus = [] {
+            cpu_set_t mask;
+            if (sched_getaffinity(::getpid(), sizeof(mask), &mask) != 0) {
+                CPU_ZERO(&mask);
+                for (std::size_t c = 0; c < std::min<std::size_t>(hardwareThreads(), CPU_SETSIZE); c++)
+                    CPU_SET(c, &mask);
+            }
+            return mask;
+        }();
+        return cpus;
+    }
+
+    /**
+     * Pin the calling thread to a single core. Failing to pin is not an error, the thread just keeps floating.
+     * @param slot Index of the thread in its pool, wrapped around the number of cores
+     */
+    void pinCurrentThread(const std::size_t slot) {
+        processCpus();
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(slot % hardwareThreads(), &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0)
+            pinnedThread = true;
+    }
+
+    /**
+     * Let the calling thread float over the cores of the process again if an earlier, pinned pool pinned it.
+     */
+    void unpinCurrentThread() {
+        if (pinnedThread && pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &processCpus()) == 0)
+            pinnedThread = false;
+    }
+
+    /**
+     * @return Size of the shared pool set by QASMPARSER_NUM_THREADS, 0 for all cores if unset or not a positive number
+     */
+    std::size_t configuredThreads() {
+        const char *value = std::getenv("QASMPARSER_NUM_THREADS");
+        if (!value || !std::isdigit(static_cast<unsigned char>(value[0])))
+            return 0;
+
+        char *end = nullptr;
+        errno = 0;
+        const unsigned long threads = std::strtoul(value, &end, 10);
+        return *end == '\0' && errno == 0 ? threads : 0;
+    }
+
+    std::mutex poolMtx;
+    std::shared_ptr<qasmparser::ThreadPool> pool;
+}
+
+class qasmparser::ThreadPool::Pinning : public tbb::task_scheduler_observer {
+private:
+    bool pin;                                                // False: Undo the pinning of an earlier pool
+
+public:
+    Pinning(tbb::task_arena &arena, const bool pin) : tbb::task_scheduler_observer(arena), pin(pin) { observe(true); }
+
+    ~Pinning() override { observe(false); }
+
+    void on_scheduler_entry(const bool isWorker) override {
+        // Threads entering via `execute` are callers, e.g. the Python thread, and are left alone
+        if (!isWorker)
+            return;
+        if (pin)
+            pinCurrentThread(tbb::this_task_arena::current_thread_index());
+        else
+            unpinCurrentThread();
+    }
+};
+
+thread_local qasmparser::ThreadPool *qasmparser::detail::currentPool = nullptr;
+
+qasmparser::ThreadPool::ThreadPool(const std::size_t threads, const bool pinCores)
+        : threads(threads == 0 ? hardwareThreads() : threads),
+          pinCores(pinCores),
+          parallelism(std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism,
+                                                            this->threads)),
+          arena(static_cast<int>(this->threads)) {
+    // Workers surviving a pinned pool keep their core until they enter this arena
+    pinning = std::make_unique<Pinning>(arena, pinCores);
+    arena.initialize();
+
+    // The OpenMP runtime reuses the team threads of the calling thread, start them now and pin all but the calling
+    // thread, or release them from a pinned pool before
+    const bool pin = pinCores;
+    #pragma omp parallel num_threads(this->threads) default(none) shared(pin)
+    {
+        if (omp_get_thread_num() != 0) {
+            if (pin)
+                pinCurrentThread(omp_get_thread_num());
+            else
+                unpinCurrentThread();
+        }
+    }
+}
+
+qasmparser::ThreadPool::ThreadPool(const ThreadPool &parent, const std::size_t threads)
+        : threads(std::clamp<std::size_t>(threads, 1, parent.threads)),
+          pinCores(false),
+          arena(static_cast<int>(this->threads)) {
+    // Workers of an unpinned pool float in the limited arena as well, also if an earlier pool pinned them
+    if (!parent.pinCores)
+        pinning = std::make_unique<Pinning>(arena, false);
+}
+
+qasmparser::ThreadPool::~ThreadPool() = default;
+
+std::shared_ptr<qasmparser::ThreadPool> qasmparser::threadPool() {
+    // Owned by the `ThreadLimit` or the loop that set it, which outlive every call made inside them
+    if (detail::currentPool)
+        return std::shared_ptr<ThreadPool>(std::shared_ptr<ThreadPool>(), detail::currentPool);
+
+    std::lock_guard<std::mutex> guard(poolMtx);
+    if (!pool) {
+        const char *pin = std::getenv("QASMPARSER_PIN_THREADS");
+        pool = std::make_shared<ThreadPool>(configuredThreads(), pin && std::string(pin) == "1");
+    }
+    return pool;
+}
+
+void qasmparser::configureThreadPool(const std::size_t threads, const bool pinCores) {
+    const std::size_t size = threads == 0 ? hardwareThreads() : threads;
+
+    std::lock_guard<std::mutex> guard(poolMtx);
+    if (pool && pool->size() == size && pool->pinned() == pinCores)
+        return;
+    // Release the old pool first, while alive its TBB worker limit also caps the new pool
+    pool.reset();
+    pool = std::make_shared<ThreadPool>(size, pinCores);
+}
+
+qasmparser::ThreadLimit::ThreadLimit(const std::size_t threads) : previous(detail::currentPool) {
+    // A worker may run a call while waiting inside another one, so no limit also clears the limit of the outer call
+    detail::currentPool = nullptr;
+    if (threads == 0)
+        return;
+    pool = std::make_shared<ThreadPool>(*threadPool(), threads);
+    detail::currentPool = pool.get();
+}
+
+qasmparser::ThreadLimit::~ThreadLimit() {
+    detail::currentPool = previous;
+}
+
+qasmparser::Schedule qasmparser::ThreadPool::schedule(const Backend backend,
+                                                      const std::size_t items,
+                                                      const std::size_t work,
+                                                      const std::size_t maxWork) const {
+    const std::size_t meanWork = std::max<std::size_t>(work / std::max<std::size_t>(items, 1), 1);
+    const bool skewed = maxWork > skewFactor * meanWork;
+
+    Backend chosen = backend;
+    if (backend == Backend::Auto) {
+        if (threads == 1 || items < 2 || work < sequentialWork)
+            chosen = Backend::Sequential;
+        else
+            chosen = skewed ? Backend::OpenMP : Backend::ExecutionPolicy;
+    }
+
+    if (chosen == Backend::Sequential)
+        return {chosen, items, items > 0 ? 1u : 0u};
+
+    // Several chunks per thread, but each chunk at least `chunkWork` gates. Skewed loops use smaller chunks, the
+    // dynamic schedule balances them.
+    const std::size_t minGrain = (chunkWork + meanWork - 1) / meanWork;
+    std::size_t grain = std::max<std::size_t>(items / (threads * chunksPerThread), 1);
+    grain = skewed ? std::min(grain, minGrain) : std::max(grain, minGrain);
+    return {chosen, grain, (items + grain - 1) / grain};
+}
+
+qasmparser::Schedule qasmparser::ThreadPool::weighted(const Schedule &schedule,
+                                                      const std::vector<std::size_t> &costs) const {
+    if (schedule.backend == Backend::Sequential)
+        return schedule;
+
+    std::vector<std::size_t> order, bounds;
+    balance(costs, order, bounds);
+    return {schedule.backend, 0, bounds.size() - 1};
+}
+
+void qasmparser::ThreadPool::balance(const std::vector<std::size_t> &costs,
+                                     std::vector<std::size_t> &order,
+                                     std::vector<std::size_t> &bounds) const {
+    constexpr std::size_t classes = std::numeric_limits<unsigned long long>::digits + 1;
+    auto costClass = [](const std::size_t cost) {  // 0 for the heaviest class, `classes - 1` for cost zero
+        return cost == 0 ? classes - 1 : static_cast<std::size_t>(__builtin_clzll(cost));
+    };
+
+    // Counting sort by cost class
+    std::array<std::size_t, classes + 1> offsets{};
+    std::size_t total = 0;
+    for (const auto cost : costs) {
+        offsets[costClass(cost) + 1]++;
+        total += cost;
+    }
+    for (std::size_t c = 1; c <= classes; c++)
+        offsets[c] += offsets[c - 1];
+
+    order.resize(costs.size());
+    for (std::size_t i = 0; i < costs.size(); i++)
+        order[offsets[costClass(costs[i])]++] = i;
+
+    // Cut into chunks of about equal cost, several per thread
+    const std::size_t target = std::max(chunkWork, total / (threads * chunksPerThread));
+    bounds.assign(1, 0);
+    std::size_t chunkCost = 0;
+    for (std::size_t k = 0; k < order.size(); k++) {
+        chunkCost += costs[order[k]];
+        if (chunkCost >= target || k + 1 == order.size()) {
+            bounds.push_back(k + 1);
+            chunkCost = 0;
+        }
+    }
+}
@@ -0,0 +1,172 @@
+//
+// Per-thread timeline of the parser's phases and parallel chunks, exported as Chrome trace JSON.
+//
+
+#include "trace.h"
+#include "fmt/core.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+
+namespace {
+    constexpr std::size_t ringCapacity = 1 << 14;           // Spans kept per thread, older ones are overwritten
+
+    struct Span {
+        const char *name;
+        std::uint64_t begin;
+        std::uint64_t end;
+        std::size_t items;
+    };
+
+    /**
+     * Ring buffer of the spans of one thread. Only its thread appends, the mutex merely keeps a collecting session
+     * from reading a span while it is written.
+     */
+    struct Ring {
+        std::mutex mtx;
+        long tid;                                            // Operating system id of the thread
+        std::vector<Span> spans;                             // Allocated on the first recorded span
+        std::size_t next = 0;                                // Total number of spans recorded
+        bool alive = true;                                   // False once the thread has exited
+    };
+
+    std::mutex registryMtx;
+    std::vector<std::shared_ptr<Ring> > rings;              // Rings of all threads that recorded a span
+
+    /**
+     * Marks the ring of a thread as dead on thread exit, so it can be dropped once no session needs it.
+     */
+    struct RingOwner {
+        std::shared_ptr<Ring> ring;
+
+        ~RingOwner() {
+            if (!ring)
+                return;
+            std::lock_guard<std::mutex> guard(ring->mtx);
+            ring->alive = false;
+        }
+    };
+
+    Ring &threadRing() {
+        thread_local RingOwner owner;
+        if (!owner.ring) {
+            owner.ring = std::make_shared<Ring>();
+            owner.ring->tid = static_cast<long>(::syscall(SYS_gettid));
+            owner.ring->spans.resize(ringCapacity);
+
+            std::lock_guard<std::mutex> guard(registryMtx);
+            rings.push_back(owner.ring);
+        }
+        return *owner.ring;
+    }
+
+    /**
+     * Escape a span label for a JSON string.
+     */
+    std::string escaped(const char *name) {
+        std::string out;
+        for (const char *c = name; *c; c++) {
+            if (*c == '"' || *c == '\\')
+                out += '\\';
+            out += *c;
+        }
+        return out;
+    }
+}
+
+std::atomic<int> qasmparser::detail::activeTraces{0};
+
+std::uint64_t qasmparser::detail::traceNow() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void qasmparser::detail::recordSpan(const char *name, const std::uint64_t begin, const std::uint64_t end,
+                                    const std::size_t items) {
+    Ring &ring = threadRing();
+    std::lock_guard<std::mutex> guard(ring.mtx);
+    ring.spans[ring.next % ringCapacity] = Span{name, begin, end, items};
+    ring.next++;
+}
+
+qasmparser::TraceSession::TraceSession() : start(detail::traceNow()) {
+    detail::activeTraces.fetch_add(1, std::memory_order_relaxed);
+}
+
+qasmparser::TraceSession::~TraceSession() {
+    if (open)
+        detail::activeTraces.fetch_sub(1, std::memory_order_relaxed);
+}
+
+std::string qasmparser::TraceSession::finish() {
+    if (open) {
+        open = false;
+        detail::activeTraces.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    std::vector<std::shared_ptr<Ring> > snapshot;
+    {
+        std::lock_guard<std::mutex> guard(registryMtx);
+        snapshot = rings;
+        // Rings of exited threads only matter to sessions still recording
+        if (detail::activeTraces.load(std::memory_order_relaxed) == 0)
+            rings.erase(std::remove_if(rings.begin(), rings.end(), [](const std::shared_ptr<Ring> &ring) {
+                std::lock_guard<std::mutex> ringGuard(ring->mtx);
+                return !ring->alive;
+            }), rings.end());
+    }
+
+    const long pid = static_cast<long>(::getpid());
+    std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    std::size_t truncated = 0;
+    bool first = true;
+
+    for (const auto &ring : snapshot) {
+        std::lock_guard<std::mutex> guard(ring->mtx);
+        const std::size_t count = std::min(ring->next, ringCapacity);
+        bool named = false;
+
+        for (std::size_t k = ring->next - count; k < ring->next; k++) {
+            const Span &span = ring->spans[k % ringCapacity];
+            if (span.begin < start)
+                continue;
+            if (!named) {
+                fmt::format_to(std::back_inserter(json),
+                               "{}{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":{},\"tid\":{},"
+                               "\"args\":{{\"name\":\"qasmparser {}\"}}}}", first ? "" : ",", pid, ring->tid,
+                               ring->tid);
+                named = true;
+                first = false;
+            }
+            // Chrome traces count in microseconds, relative to the start of the session
+            fmt::format_to(std::back_inserter(json),
+                           ",{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":{},\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f},"
+                           "\"args\":{{\"items\":{}}}}}", escaped(span.name), pid, ring->tid,
+                           static_cast<double>(span.begin - start) * 1e-3,
+                           static_cast<double>(span.end - span.begin) * 1e-3, span.items);
+        }
+
+        // The oldest kept span belongs to the session, earlier spans of the session may have been overwritten
+        if (ring->next > ringCapacity && ring->spans[ring->next % ringCapacity].begin >= start)
+            truncated++;
+    }
+
+    fmt::format_to(std::back_inserter(json), "],\"otherData\":{{\"truncatedThreads\":{}}}}}\n", truncated);
+    return json;
+}
+
+void qasmparser::TraceSession::write(const std::string &outFilename) {
+    const std::string json = finish();
+    std::ofstream outFile(outFilename, std::ios::binary);
+    outFile << json;
+    if (!outFile.good())
+        throw std::runtime_error(fmt::format("Cannot write {}!", outFilename));
+}
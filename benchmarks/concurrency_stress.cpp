@@ -0,0 +1,188 @@
+//
+// Concurrent compiles from many threads, checked against sequential results.
+//
+
+#include "parser.h"
+#include "thread_pool.h"
+#include "fmt/core.h"
+
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace {
+    using qasmparser::Backend;
+
+    /**
+     * Compile options varied between the concurrent calls.
+     */
+    struct Config {
+        int version;
+        Backend backend;
+        bool parameterize;
+        double multiplier;
+    };
+
+    /**
+     * Write a random Hamiltonian with mostly light terms and a few heavy ones, so that both the chunked loops and the
+     * split ladders of heavy operators run concurrently.
+     * @param path Output file
+     * @param qubits Number of qubits
+     * @param terms Number of terms
+     */
+    void writeHamiltonian(const std::string &path, const std::size_t qubits, const std::size_t terms) {
+        std::mt19937_64 rng(42);
+        std::uniform_int_distribution<int> pauli(1, 3);
+        std::uniform_real_distribution<double> coef(-1, 1);
+        std::ofstream out(path);
+        for (std::size_t t = 0; t < terms; t++) {
+            std::string op(qubits, 'I');
+            if (t % 97 == 0) {
+                for (auto &ch : op)
+                    ch = "IXYZ"[pauli(rng)];
+            } else {
+                for (std::size_t w = 0; w < 2 + rng() % 3; w++)
+                    op[rng() % qubits] = "IXYZ"[pauli(rng)];
+            }
+            out << op << ' ' << coef(rng) + 1.5 << ' ' << (t % 5 == 0 ? 1 : 0) << '\n';
+        }
+    }
+}
+
+/**
+ * Usage: qasm_concurrency_stress [callers] [rounds] [terms] [qubits]
+ * Every caller thread compiles the input `rounds` times with varying options, through `parseCircuit`, through a
+ * shared `Parser` session and as a batch through `parseCircuits`, and feeds a faulty input, alone or as a batch, in
+ * between. Afterwards a batch containing the faulty input runs on every backend, a batch is cancelled halfway on every
+ * backend, and `rounds` streams are closed by one thread while another waits for their next chunk. Exits with 1 if any
+ * output differs from the sequential reference, an error is not reported as an exception or a consumer of a closed
+ * stream does not return.
+ */
+int main(int argc, char **argv) {
+    const std::size_t callers = argc > 1 ? std::stoul(argv[1]) : 8;
+    const std::size_t rounds = argc > 2 ? std::stoul(argv[2]) : 20;
+    const std::size_t terms = argc > 3 ? std::stoul(argv[3]) : 2000;
+    const std::size_t qubits = argc > 4 ? std::stoul(argv[4]) : 5000;
+
+    const auto dir = std::filesystem::temp_directory_path();
+    const std::string input = (dir / fmt::format("qasm_stress_{}.txt", ::getpid())).string();
+    const std::string faulty = (dir / fmt::format("qasm_stress_{}_faulty.txt", ::getpid())).string();
+    writeHamiltonian(input, qubits, terms);
+    std::ofstream(faulty) << "XXZ 0.5 0\nXAZ 0.5 0\n";
+
+    const std::vector<Config> configs = {
+            {2, Backend::OpenMP, false, 2},
+            {3, Backend::ExecutionPolicy, true, 2},
+            {3, Backend::Auto, true, 0.5},
+            {3, Backend::OpenMP, false, 1},
+            {2, Backend::ExecutionPolicy, false, 4},
+    };
+
+    // Sequential references
+    std::vector<std::string> references;
+    for (const auto &c : configs)
+        references.push_back(qasmparser::parseCircuit(input, c.version, Backend::Sequential, c.parameterize,
+                                                       std::nullopt, c.multiplier));
+    const qasmparser::Parser session(input, Backend::Auto);
+
+    std::atomic<std::size_t> mismatches{0}, missedErrors{0};
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < callers; t++) {
+        threads.emplace_back([&, t] {
+            for (std::size_t r = 0; r < rounds; r++) {
+                const std::size_t k = (t + r) % configs.size();
+                const auto &c = configs[k];
+                std::vector<std::string> qasms;
+                switch ((t + r) % 3) {
+                    case 0:
+                        qasms.push_back(qasmparser::parseCircuit(input, c.version, c.backend, c.parameterize,
+                                                                 std::nullopt, c.multiplier));
+                        break;
+                    case 1:
+                        qasms.push_back(session.emit(c.version, c.backend, c.parameterize, std::nullopt,
+                                                     c.multiplier));
+                        break;
+                    default:
+                        qasms = qasmparser::parseCircuits({input, input}, c.version, c.backend, c.parameterize, {},
+                                                          c.multiplier);
+                }
+                for (const auto &qasm : qasms)
+                    if (qasm != references[k])
+                        mismatches++;
+
+                // The faulty input alone throws on the calling thread, in a batch on the pool's workers
+                try {
+                    if (r % 2 == 0)
+                        qasmparser::parseCircuit(faulty, 3, c.backend);
+                    else
+                        qasmparser::parseCircuits({faulty, faulty, faulty, faulty}, 3, c.backend);
+                    missedErrors++;
+                }
+                catch (const std::invalid_argument &) {}
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    // A faulty file in a batch throws on a worker thread, every backend must hand the error to the caller
+    for (const auto backend : {Backend::Sequential, Backend::OpenMP, Backend::ExecutionPolicy, Backend::Auto}) {
+        try {
+            qasmparser::parseCircuits({input, faulty, input, input}, 3, backend);
+            missedErrors++;
+        }
+        catch (const std::invalid_argument &) {}
+    }
+
+    // Cancelling a batch midway throws `Cancelled` on the workers, the caller must get it and the pool stay usable
+    const std::vector<std::string> batch(4, input);
+    for (const auto backend : {Backend::Sequential, Backend::OpenMP, Backend::ExecutionPolicy, Backend::Auto}) {
+        const auto start = std::chrono::steady_clock::now();
+        qasmparser::parseCircuits(batch, 3, backend);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        try {
+            qasmparser::parseCircuits(batch, 3, backend, true, {}, std::nullopt, qasmparser::CoefficientInputs::Off,
+                                      qasmparser::CancellationToken().withTimeout(seconds / 2));
+        }
+        catch (const qasmparser::Cancelled &) {}
+
+        const auto &c = configs[1];
+        if (qasmparser::parseCircuit(input, c.version, backend, c.parameterize, std::nullopt, c.multiplier) !=
+            references[1])
+            mismatches++;
+    }
+
+    // Closing a stream from one thread must wake a consumer waiting for the next chunk on another thread
+    const auto parser = std::make_shared<const qasmparser::Parser>(input, Backend::Auto);
+    for (std::size_t r = 0; r < rounds; r++) {
+        qasmparser::CircuitStream stream(parser, 3, configs[r % configs.size()].backend, true, std::nullopt,
+                                         qasmparser::CoefficientInputs::Off, 1);
+        auto consumer = std::async(std::launch::async, [&stream] {
+            while (stream.next()) {}
+        });
+        std::this_thread::sleep_for(std::chrono::microseconds(200 * r));
+        stream.close();
+        if (consumer.wait_for(std::chrono::seconds(30)) == std::future_status::timeout) {
+            fmt::print(stderr, "Consumer of a closed stream did not return\n");
+            std::quick_exit(1);
+        }
+        consumer.get();
+    }
+
+    std::remove(input.c_str());
+    std::remove(faulty.c_str());
+
+    fmt::print("{} callers x {} rounds on {} threads: {} mismatches, {} missed errors\n",
+               callers, rounds, qasmparser::threadPool()->size(), mismatches.load(), missedErrors.load());
+    return mismatches == 0 && missedErrors == 0 ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+//
+// Command line front end of the synthetic Hamiltonian generator.
+//
+
+#include "generator.h"
+#include "fmt/core.h"
+
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+
+namespace {
+    const std::map<std::string, qasmparser::HamiltonianFamily> families = {
+            {"sparse", qasmparser::HamiltonianFamily::RandomSparse},
+            {"fixed", qasmparser::HamiltonianFamily::FixedWeight},
+            {"jw", qasmparser::HamiltonianFamily::JordanWigner},
+            {"lattice", qasmparser::HamiltonianFamily::Lattice},
+    };
+
+    void usage() {
+        fmt::print(stderr, "Usage: qasm_generate <output> [--family sparse|fixed|jw|lattice] [--qubits n] [--terms n]\n"
+                           "                     [--min-weight n] [--max-weight n] [--parameters n] [--width n]\n"
+                           "                     [--seed n]\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || std::strcmp(argv[1], "--help") == 0) {
+        usage();
+        return argc < 2 ? 1 : 0;
+    }
+
+    qasmparser::GeneratorOptions options;
+    try {
+        for (int i = 2; i + 1 < argc; i += 2) {
+            const std::string flag = argv[i], value = argv[i + 1];
+            if (flag == "--family")
+                options.family = families.at(value);
+            else if (flag == "--qubits")
+                options.qubits = std::stoul(value);
+            else if (flag == "--terms")
+                options.terms = std::stoull(value);
+            else if (flag == "--min-weight")
+                options.minWeight = std::stoull(value);
+            else if (flag == "--max-weight")
+                options.maxWeight = std::stoull(value);
+            else if (flag == "--parameters")
+                options.parameters = std::stoull(value);
+            else if (flag == "--width")
+                options.latticeWidth = std::stoul(value);
+            else if (flag == "--seed")
+                options.seed = std::stoull(value);
+            else
+                throw std::invalid_argument("Unknown option " + flag + "!");
+        }
+        if (argc % 2 != 0)
+            throw std::invalid_argument("Missing value of option " + std::string(argv[argc - 1]) + "!");
+
+        const auto start = std::chrono::steady_clock::now();
+        qasmparser::writeHamiltonian(options, argv[1], qasmparser::Backend::Auto);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        fmt::print("Wrote {} terms on {} qubits to {} in {:.3f} s\n", options.terms, options.qubits, argv[1],
+                   elapsed.count());
+    }
+    catch (const std::out_of_range &) {
+        fmt::print(stderr, "Unknown family or value out of range!\n");
+        usage();
+        return 1;
+    }
+    catch (const std::exception &exception) {
+        fmt::print(stderr, "{}\n", exception.what());
+        usage();
+        return 1;
+    }
+    return 0;
+}
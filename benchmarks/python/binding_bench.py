@@ -0,0 +1,145 @@
+"""Benchmarks of the Python binding: call overhead, return conversion and throughput of concurrent callers.
+
+Runs against the installed `openqasmparser` module, e.g. after `cmake --install .`:
+
+    python benchmarks/python/binding_bench.py [--only overhead|conversion|threads] [--repeat n] [--json file]
+
+Library-side times are taken from the statistics returned with `stats=True`, so the difference to the time measured
+in Python is the cost of the binding: argument conversion, GIL hand-over and conversion of the result into `str`.
+"""
+
+import argparse
+import json
+import os
+import statistics
+import tempfile
+import threading
+import time
+import timeit
+
+import openqasmparser
+
+
+def generate(directory, name, **options):
+    """Write a seeded synthetic Hamiltonian and return its path."""
+    path = os.path.join(directory, name)
+    openqasmparser.generate_hamiltonian(path, **options)
+    return path
+
+
+def library_seconds(stats):
+    """Time spent inside the library according to the statistics of a compile."""
+    return sum(stats["seconds"].values())
+
+
+def bench_overhead(directory, repeat):
+    """Per-call overhead on a single-term input, where the binding dominates the cost."""
+    path = generate(directory, "tiny.txt", qubits=4, terms=1, min_weight=1, max_weight=2)
+    session = openqasmparser.CompiledHamiltonian(path)
+    number = 2000
+
+    results = {}
+    for name, call in [("parse_circuit", lambda: openqasmparser.parse_circuit(path)),
+                       ("parse_circuit(stats=True)", lambda: openqasmparser.parse_circuit(path, stats=True)),
+                       ("CompiledHamiltonian.emit", lambda: session.emit())]:
+        times = timeit.repeat(call, number=number, repeat=repeat)
+        results[name] = min(times) / number
+
+    inside = statistics.median(library_seconds(openqasmparser.parse_circuit(path, stats=True)[1])
+                               for _ in range(number))
+    results["library share of parse_circuit"] = inside
+
+    print("Call overhead on a single term")
+    for name, seconds in results.items():
+        print(f"  {name:<34}{seconds * 1e6:>10.2f} us")
+    print(f"  {'binding overhead':<34}{(results['parse_circuit'] - inside) * 1e6:>10.2f} us")
+    return results
+
+
+def bench_conversion(directory, repeat):
+    """Cost of converting huge results into Python strings, against streaming and writing to a file."""
+    path = generate(directory, "huge.txt", qubits=64, terms=200000, min_weight=2, max_weight=16, parameters=16)
+    session = openqasmparser.CompiledHamiltonian(path)
+    output = os.path.join(directory, "huge.qasm")
+
+    rows = []
+    for _ in range(repeat):
+        start = time.perf_counter()
+        qasm, stats = session.emit(stats=True)
+        total = time.perf_counter() - start
+        inside = stats["seconds"]["emit"] + stats["seconds"]["assemble"]
+        rows.append((total, inside, len(qasm)))
+        del qasm
+
+    def best(call):
+        return min(timeit.repeat(call, number=1, repeat=repeat))
+
+    streamed = best(lambda: sum(len(chunk) for chunk in session.iter_emit()))
+    written = best(lambda: session.emit(output_fn=output))
+
+    total, inside, size = min(rows)
+    conversion = total - inside
+    print(f"Return conversion of {size / 1e6:.1f} MB")
+    print(f"  {'emit returning str':<34}{total * 1e3:>10.2f} ms")
+    print(f"  {'library share':<34}{inside * 1e3:>10.2f} ms")
+    rate = size / max(conversion, 1e-9) / 1e9
+    print(f"  {'conversion to str':<34}{conversion * 1e3:>10.2f} ms  ({rate:.2f} GB/s)")
+    print(f"  {'iter_emit, consumed':<34}{streamed * 1e3:>10.2f} ms")
+    print(f"  {'emit with output_fn':<34}{written * 1e3:>10.2f} ms")
+    return {"bytes": size, "emit_s": total, "library_s": inside, "conversion_s": conversion,
+            "iter_emit_s": streamed, "emit_to_file_s": written}
+
+
+def bench_threads(directory, repeat):
+    """Throughput of concurrent sequential compiles; they release the GIL, so it should grow with the callers."""
+    path = generate(directory, "medium.txt", qubits=32, terms=20000, parameters=16)
+    calls = 32
+
+    def run(threads):
+        barrier = threading.Barrier(threads)
+
+        def worker(count):
+            barrier.wait()
+            for _ in range(count):
+                openqasmparser.parse_circuit(path, backend=openqasmparser.Backend.SEQUENTIAL)
+
+        pool = [threading.Thread(target=worker, args=(calls // threads,)) for _ in range(threads)]
+        start = time.perf_counter()
+        for thread in pool:
+            thread.start()
+        for thread in pool:
+            thread.join()
+        return (calls // threads) * threads / (time.perf_counter() - start)
+
+    results = {}
+    print(f"Throughput of concurrent callers, {calls} compiles per run")
+    for threads in [1, 2, 4, 8]:
+        rates = [run(threads) for _ in range(repeat)]
+        results[threads] = {"mean": statistics.mean(rates),
+                            "stdev": statistics.stdev(rates) if len(rates) > 1 else 0.0}
+        print(f"  {threads:>2} threads{results[threads]['mean']:>12.1f} compiles/s"
+              f"  +- {results[threads]['stdev']:.1f}  ({results[threads]['mean'] / results[1]['mean']:.2f}x)")
+    return results
+
+
+def main():
+    benchmarks = {"overhead": bench_overhead, "conversion": bench_conversion, "threads": bench_threads}
+
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--only", choices=benchmarks, action="append", help="Run only the given benchmark")
+    parser.add_argument("--repeat", type=int, default=5, help="Repetitions of each measurement")
+    parser.add_argument("--json", help="Write the results to this file")
+    args = parser.parse_args()
+
+    results = {}
+    with tempfile.TemporaryDirectory() as directory:
+        for name in args.only or benchmarks:
+            results[name] = benchmarks[name](directory, max(args.repeat, 1))
+
+    if args.json:
+        with open(args.json, "w") as out:
+            json.dump(results, out, indent=2)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,254 @@
+//
+// Google Benchmark suite timing every phase of the parser separately and end to end.
+//
+
+#include "generator.h"
+#include "parser.h"
+#include "fmt/core.h"
+
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+
+namespace qasmparser {
+    /**
+     * Access to the private phases of the parser, so each one is timed on its own.
+     */
+    struct PhaseAccess {
+        static Parser read(const std::string &filename) {
+            Parser p;
+            p.readLines(filename, CancellationToken());
+            return p;
+        }
+
+        static void convert(Parser &p, const Backend backend) {
+            p.convertOperators(backend, CancellationToken());
+        }
+
+        static std::size_t strInt(Parser &p) {
+            std::size_t active = 0;
+            for (auto &op : p.operators)
+                active += Parser::parseStrInt(op.strRep)[0].size();
+            return active;
+        }
+
+        static std::size_t opToQasm(const Parser &p) {
+            std::string qasm;
+            std::size_t bytes = 0;
+            for (const auto &op : p.operators) {
+                qasm.clear();
+                Parser::parseOpToQasm(op, "2*param1", qasm);
+                bytes += qasm.size();
+            }
+            return bytes;
+        }
+
+        static auto emit(const Parser &p, const Backend backend) {
+            std::string preamble;
+            const auto angle = p.emission(3, true, std::nullopt, CoefficientInputs::Off, preamble);
+            return p.parseOperators(backend, angle, 0, p.operators.size());
+        }
+
+        template <typename Fragments>
+        static std::string assemble(const Fragments &fragments) {
+            std::string qasm;
+            Parser::assemble(qasm, fragments);
+            return qasm;
+        }
+    };
+}
+
+namespace {
+    using qasmparser::Backend;
+
+    /**
+     * Pauli-weight distribution of the synthetic inputs.
+     */
+    enum Distribution {
+        Sparse,                                              // Two to four active qubits per term
+        Dense,                                               // Half of the qubits active
+        JordanWigner                                         // X or Y at both ends of a Z string of random length
+    };
+
+    constexpr std::size_t maxInputChars = std::size_t(1) << 28;  // Inputs above this size are not registered
+
+    std::vector<std::string> created;                        // Input files removed on exit
+
+    /**
+     * Path of the synthetic input with the given shape, generated on first use. Inputs are seeded, so every run and
+     * version of the library reads the same files.
+     */
+    const std::string &input(const std::size_t terms, const std::size_t qubits, const int distribution) {
+        static std::map<std::tuple<std::size_t, std::size_t, int>, std::string> paths;
+        auto &path = paths[{terms, qubits, distribution}];
+        if (!path.empty())
+            return path;
+
+        path = (std::filesystem::temp_directory_path() /
+                fmt::format("qasm_bench_{}_{}_{}_{}.txt", ::getpid(), terms, qubits, distribution)).string();
+        created.push_back(path);
+
+        qasmparser::GeneratorOptions options;
+        options.qubits = qubits;
+        options.terms = terms;
+        options.parameters = terms / 4;
+        switch (distribution) {
+            case Sparse:
+                options.family = qasmparser::HamiltonianFamily::RandomSparse;
+                options.minWeight = 2;
+                options.maxWeight = 4;
+                break;
+            case Dense:
+                options.family = qasmparser::HamiltonianFamily::FixedWeight;
+                options.minWeight = qubits / 2;
+                break;
+            default:
+                options.family = qasmparser::HamiltonianFamily::JordanWigner;
+                options.minWeight = 2;
+                options.maxWeight = qubits;
+        }
+        qasmparser::writeHamiltonian(options, path, Backend::Auto);
+        return path;
+    }
+
+    /**
+     * Terms from 10^2 to 10^7, 16 to 256 qubits and all distributions, skipping inputs larger than `maxInputChars`.
+     * @tparam backends Also sweep over the sequential, OpenMP and execution policy backends
+     */
+    template <bool backends>
+    void shapes(benchmark::internal::Benchmark *b) {
+        for (std::size_t terms = 100; terms <= 10000000; terms *= 10)
+            for (std::size_t qubits : {16, 64, 256})
+                for (int distribution : {Sparse, Dense, JordanWigner}) {
+                    if (terms * qubits > maxInputChars)
+                        continue;
+                    const auto t = static_cast<std::int64_t>(terms), q = static_cast<std::int64_t>(qubits);
+                    if (!backends)
+                        b->Args({t, q, distribution});
+                    else
+                        for (int backend : {0, 1, 2})
+                            b->Args({t, q, distribution, backend});
+                }
+    }
+
+    const std::string &input(const benchmark::State &state) {
+        return input(state.range(0), state.range(1), static_cast<int>(state.range(2)));
+    }
+
+    Backend backend(const benchmark::State &state) {
+        return std::array<Backend, 3>{Backend::Sequential, Backend::OpenMP, Backend::ExecutionPolicy}[state.range(3)];
+    }
+
+    void setCounters(benchmark::State &state) {
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+        state.SetBytesProcessed(state.iterations() *
+                                static_cast<std::int64_t>(std::filesystem::file_size(input(state))));
+    }
+
+    void BM_ReadLines(benchmark::State &state) {
+        const auto &path = input(state);
+        for (auto _ : state)
+            benchmark::DoNotOptimize(qasmparser::PhaseAccess::read(path));
+        setCounters(state);
+    }
+
+    void BM_ParseStrInt(benchmark::State &state) {
+        auto p = qasmparser::PhaseAccess::read(input(state));
+        for (auto _ : state)
+            benchmark::DoNotOptimize(qasmparser::PhaseAccess::strInt(p));
+        setCounters(state);
+    }
+
+    void BM_Convert(benchmark::State &state) {
+        const auto read = qasmparser::PhaseAccess::read(input(state));
+        for (auto _ : state) {
+            state.PauseTiming();
+            auto p = read;
+            state.ResumeTiming();
+            qasmparser::PhaseAccess::convert(p, backend(state));
+            benchmark::DoNotOptimize(p);
+        }
+        setCounters(state);
+    }
+
+    void BM_ParseOpToQasm(benchmark::State &state) {
+        const qasmparser::Parser p(input(state), Backend::Sequential);
+        for (auto _ : state)
+            benchmark::DoNotOptimize(qasmparser::PhaseAccess::opToQasm(p));
+        setCounters(state);
+    }
+
+    void BM_Emit(benchmark::State &state) {
+        const qasmparser::Parser p(input(state), Backend::Sequential);
+        for (auto _ : state)
+            benchmark::DoNotOptimize(qasmparser::PhaseAccess::emit(p, backend(state)));
+        setCounters(state);
+    }
+
+    void BM_Assemble(benchmark::State &state) {
+        const qasmparser::Parser p(input(state), Backend::Sequential);
+        const auto fragments = qasmparser::PhaseAccess::emit(p, Backend::Sequential);
+        for (auto _ : state)
+            benchmark::DoNotOptimize(qasmparser::PhaseAccess::assemble(fragments));
+        setCounters(state);
+    }
+
+    void BM_EndToEnd(benchmark::State &state) {
+        const auto &path = input(state);
+        for (auto _ : state)
+            benchmark::DoNotOptimize(qasmparser::parseCircuit(path, 3, backend(state)));
+        setCounters(state);
+    }
+}
+
+BENCHMARK(BM_ReadLines)->Apply(shapes<false>)->ArgNames({"terms", "qubits", "dist"})
+        ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ParseStrInt)->Apply(shapes<false>)->ArgNames({"terms", "qubits", "dist"})
+        ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Convert)->Apply(shapes<true>)->ArgNames({"terms", "qubits", "dist", "backend"})
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_ParseOpToQasm)->Apply(shapes<false>)->ArgNames({"terms", "qubits", "dist"})
+        ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Emit)->Apply(shapes<true>)->ArgNames({"terms", "qubits", "dist", "backend"})
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Assemble)->Apply(shapes<false>)->ArgNames({"terms", "qubits", "dist"})
+        ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_EndToEnd)->Apply(shapes<true>)->ArgNames({"terms", "qubits", "dist", "backend"})
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/**
+ * Runs the suite like BENCHMARK_MAIN, but also writes the results as JSON to qasm_bench.json unless another
+ * `--benchmark_out` is given, so every run can be tracked across versions.
+ */
+int main(int argc, char **argv) {
+    std::vector<char *> args(argv, argv + argc);
+    bool out = false;
+    for (int i = 1; i < argc; i++)
+        out = out || std::strncmp(argv[i], "--benchmark_out=", 16) == 0;
+
+    char outFile[] = "--benchmark_out=qasm_bench.json";
+    char outFormat[] = "--benchmark_out_format=json";
+    if (!out) {
+        args.push_back(outFile);
+        args.push_back(outFormat);
+    }
+
+    int count = static_cast<int>(args.size());
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data()))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    for (const auto &path : created)
+        std::remove(path.c_str());
+    return 0;
+}
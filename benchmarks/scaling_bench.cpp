@@ -0,0 +1,185 @@
+//
+// Thread scaling of complete compiles on the sequential, OpenMP and execution policy backends.
+//
+
+#include "generator.h"
+#include "parser.h"
+#include "fmt/core.h"
+
+#include <unistd.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    using qasmparser::Backend;
+
+    struct Sample {
+        double mean;                                         // Mean wall time in seconds
+        double stddev;                                       // Sample standard deviation in seconds
+        double min;                                          // Fastest repetition in seconds
+        bool identical;                                      // Every repetition matched the sequential output
+    };
+
+    /**
+     * Compile an input repeatedly and compare every output to the reference.
+     */
+    Sample measure(const std::string &path,
+                   const Backend backend,
+                   const int repetitions,
+                   const std::string &reference) {
+        std::vector<double> times;
+        bool identical = true;
+        for (int r = 0; r < repetitions; r++) {
+            const auto start = Clock::now();
+            const std::string qasm = qasmparser::parseCircuit(path, 3, backend);
+            times.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+            identical = identical && qasm == reference;
+        }
+
+        double sum = 0, squares = 0, min = times.front();
+        for (const double t : times) {
+            sum += t;
+            min = std::min(min, t);
+        }
+        const double mean = sum / static_cast<double>(times.size());
+        for (const double t : times)
+            squares += (t - mean) * (t - mean);
+        const double stddev = times.size() > 1 ? std::sqrt(squares / static_cast<double>(times.size() - 1)) : 0;
+        return {mean, stddev, min, identical};
+    }
+
+    /**
+     * Thread counts from 1 to `maxThreads`, doubling, the maximum always included.
+     */
+    std::vector<std::size_t> threadCounts(const std::size_t maxThreads) {
+        std::vector<std::size_t> counts;
+        for (std::size_t t = 1; t < maxThreads; t *= 2)
+            counts.push_back(t);
+        counts.push_back(maxThreads);
+        return counts;
+    }
+
+    /**
+     * Fixed synthetic inputs, used when no input files are given: many light terms and fewer heavy Jordan-Wigner
+     * strings.
+     */
+    std::vector<std::string> defaultInputs(std::vector<std::string> &created) {
+        qasmparser::GeneratorOptions sparse;
+        sparse.qubits = 64;
+        sparse.terms = 50000;
+        sparse.parameters = sparse.terms / 4;
+
+        qasmparser::GeneratorOptions jordanWigner;
+        jordanWigner.family = qasmparser::HamiltonianFamily::JordanWigner;
+        jordanWigner.qubits = 256;
+        jordanWigner.terms = 10000;
+        jordanWigner.maxWeight = 128;
+        jordanWigner.parameters = jordanWigner.terms / 4;
+
+        for (const auto &[name, options] : {std::pair("sparse", sparse), std::pair("jw", jordanWigner)}) {
+            created.push_back((std::filesystem::temp_directory_path() /
+                               fmt::format("qasm_scaling_{}_{}.txt", ::getpid(), name)).string());
+            qasmparser::writeHamiltonian(options, created.back(), Backend::Auto);
+        }
+        return created;
+    }
+
+    void usage() {
+        fmt::print(stderr, "Usage: qasm_scaling_bench [--input file]... [--max-threads n] [--repetitions n]\n"
+                           "                          [--csv file]\n");
+    }
+}
+
+/**
+ * Sweeps the worker pool from 1 thread to all cores for each backend and input, reports speedup over the sequential
+ * backend, parallel efficiency and variance as a summary table and as CSV, and checks that every backend and thread
+ * count produces byte-identical output. Exits with 1 if any output differs.
+ */
+int main(int argc, char **argv) {
+    std::vector<std::string> inputs, created;
+    std::size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    int repetitions = 5;
+    std::string csvFilename = "qasm_scaling.csv";
+
+    try {
+        for (int i = 1; i < argc; i += 2) {
+            const std::string flag = argv[i];
+            if (flag == "--help") {
+                usage();
+                return 0;
+            }
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value of option " + flag + "!");
+            const std::string value = argv[i + 1];
+            if (flag == "--input")
+                inputs.push_back(value);
+            else if (flag == "--max-threads")
+                maxThreads = std::max<std::size_t>(std::stoul(value), 1);
+            else if (flag == "--repetitions")
+                repetitions = std::max(std::stoi(value), 1);
+            else if (flag == "--csv")
+                csvFilename = value;
+            else
+                throw std::invalid_argument("Unknown option " + flag + "!");
+        }
+        if (inputs.empty())
+            inputs = defaultInputs(created);
+    }
+    catch (const std::exception &exception) {
+        fmt::print(stderr, "{}\n", exception.what());
+        usage();
+        return 1;
+    }
+
+    std::ofstream csv(csvFilename);
+    csv << "input,backend,threads,repetitions,mean_s,stddev_s,min_s,speedup,efficiency,identical\n";
+    fmt::print("{:<36}{:<18}{:>8}{:>12}{:>10}{:>10}{:>12}{:>11}\n", "input", "backend", "threads", "mean [ms]",
+               "cv [%]", "speedup", "efficiency", "identical");
+
+    bool allIdentical = true;
+    const auto report = [&](const std::string &input, const char *backend, const std::size_t threads,
+                            const Sample &sample, const double sequential) {
+        const double speedup = sequential / sample.mean;
+        const double efficiency = speedup / static_cast<double>(threads);
+        allIdentical = allIdentical && sample.identical;
+        csv << fmt::format("{},{},{},{},{:.6f},{:.6f},{:.6f},{:.3f},{:.3f},{}\n", input, backend, threads,
+                           repetitions, sample.mean, sample.stddev, sample.min, speedup, efficiency,
+                           sample.identical ? "true" : "false");
+        fmt::print("{:<36}{:<18}{:>8}{:>12.2f}{:>10.1f}{:>10.2f}{:>12.2f}{:>11}\n",
+                   std::filesystem::path(input).filename().string(), backend, threads, sample.mean * 1e3,
+                   100 * sample.stddev / sample.mean, speedup, efficiency, sample.identical ? "yes" : "NO");
+    };
+
+    for (const auto &input : inputs) {
+        // The sequential backend is the baseline and its output the reference of all others
+        qasmparser::configureThreadPool(1);
+        const std::string reference = qasmparser::parseCircuit(input, 3, Backend::Sequential);
+        const Sample sequential = measure(input, Backend::Sequential, repetitions, reference);
+        report(input, "Sequential", 1, sequential, sequential.mean);
+
+        for (const auto threads : threadCounts(maxThreads)) {
+            qasmparser::configureThreadPool(threads);
+            for (const auto &[name, backend] : {std::pair("OpenMP", Backend::OpenMP),
+                                                std::pair("ExecutionPolicy", Backend::ExecutionPolicy)})
+                report(input, name, threads, measure(input, backend, repetitions, reference), sequential.mean);
+        }
+    }
+
+    for (const auto &path : created)
+        std::remove(path.c_str());
+    fmt::print("Results written to {}\n", csvFilename);
+    if (!allIdentical) {
+        fmt::print(stderr, "Outputs differ between backends!\n");
+        return 1;
+    }
+    return 0;
+}
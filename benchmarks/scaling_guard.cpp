@@ -0,0 +1,169 @@
+//
+// Guard against super-linear phases: fits the scaling exponent of every phase over geometrically growing inputs.
+//
+
+#include "generator.h"
+#include "parser.h"
+#include "fmt/core.h"
+
+#include <malloc.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace {
+    using qasmparser::Backend;
+
+    constexpr std::size_t points = 5;                        // Input sizes per sweep, each twice the previous one
+    constexpr double minSeconds = 1e-3;                      // Phases faster than this at the largest size are noise
+
+    /**
+     * Inputs growing along one dimension, all other dimensions fixed.
+     */
+    struct Sweep {
+        const char *name;
+        std::size_t first;                                   // Size of the smallest input
+        std::function<qasmparser::GeneratorOptions(std::size_t)> options;
+    };
+
+    const std::vector<Sweep> sweeps = {
+            // Growing number of light terms, each with a parameter of its own
+            {"terms", 16000, [](const std::size_t terms) {
+                qasmparser::GeneratorOptions options;
+                options.qubits = 64;
+                options.terms = terms;
+                return options;
+            }},
+            // Growing Pauli weight at a fixed number of terms, half of the qubits active
+            {"weight", 64, [](const std::size_t qubits) {
+                qasmparser::GeneratorOptions options;
+                options.family = qasmparser::HamiltonianFamily::FixedWeight;
+                options.qubits = qubits;
+                options.terms = 2000;
+                options.minWeight = qubits / 2;
+                return options;
+            }},
+    };
+
+    const std::vector<std::pair<const char *, double qasmparser::CompileStats::*> > phases = {
+            {"read", &qasmparser::CompileStats::readSeconds},
+            {"convert", &qasmparser::CompileStats::convertSeconds},
+            {"emit", &qasmparser::CompileStats::emitSeconds},
+            {"assemble", &qasmparser::CompileStats::assembleSeconds},
+    };
+
+    /**
+     * @return Median of `values`, which must not be empty
+     */
+    double median(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        const std::size_t mid = values.size() / 2;
+        return values.size() % 2 == 1 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+    }
+
+    /**
+     * Exponent `k` of time ~ size^k, the median of the slopes between successive sizes in log-log scale. Unlike a
+     * least-squares fit, a single step in the timings, e.g. when the output outgrows a cache or an allocator
+     * threshold, does not dominate the result, whereas super-linear algorithms raise every slope.
+     */
+    double exponent(const std::vector<double> &sizes, const std::vector<double> &times) {
+        std::vector<double> slopes;
+        for (std::size_t i = 1; i < sizes.size(); i++)
+            slopes.push_back(std::log(times[i] / times[i - 1]) / std::log(sizes[i] / sizes[i - 1]));
+        return median(slopes);
+    }
+
+    void usage() {
+        fmt::print(stderr, "Usage: qasm_scaling_guard [--threshold x] [--repetitions n]\n");
+    }
+}
+
+/**
+ * Compiles sequentially at sizes growing geometrically, takes the median repetition of every phase from the compile
+ * statistics and fits its scaling exponent. Every phase is expected to be linear; exits with 1 if any exponent
+ * exceeds the threshold, so quadratic behavior fails the run instead of surfacing in production.
+ */
+int main(int argc, char **argv) {
+    double threshold = 1.2;
+    int repetitions = 5;
+    try {
+        for (int i = 1; i < argc; i += 2) {
+            const std::string flag = argv[i];
+            if (flag == "--help") {
+                usage();
+                return 0;
+            }
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value of option " + flag + "!");
+            if (flag == "--threshold")
+                threshold = std::stod(argv[i + 1]);
+            else if (flag == "--repetitions")
+                repetitions = std::max(std::stoi(argv[i + 1]), 1);
+            else
+                throw std::invalid_argument("Unknown option " + flag + "!");
+        }
+    }
+    catch (const std::exception &exception) {
+        fmt::print(stderr, "{}\n", exception.what());
+        usage();
+        return 1;
+    }
+
+    // Keep every allocation on the heap and never return it, so all sizes reuse warm pages. Otherwise outputs beyond
+    // glibc's mmap threshold pay for fresh pages on every compile, a step in the timings that is not the library's.
+    mallopt(M_MMAP_THRESHOLD, std::numeric_limits<int>::max());
+    mallopt(M_TRIM_THRESHOLD, std::numeric_limits<int>::max());
+
+    const std::string path = (std::filesystem::temp_directory_path() /
+                              fmt::format("qasm_scaling_guard_{}.txt", ::getpid())).string();
+    bool failed = false;
+    fmt::print("{:<10}{:<10}{:>14}{:>12}{:>10}  {}\n", "sweep", "phase", "largest [ms]", "exponent", "limit",
+               "result");
+
+    for (const auto &sweep : sweeps) {
+        std::vector<double> sizes;
+        std::vector<std::vector<double> > times(phases.size());
+
+        for (std::size_t p = 0, size = sweep.first; p < points; p++, size *= 2) {
+            qasmparser::writeHamiltonian(sweep.options(size), path, Backend::Sequential);
+            sizes.push_back(static_cast<double>(size));
+
+            // The first compile of a size warms up the heap and is not timed
+            std::vector<std::vector<double> > samples(phases.size());
+            for (int r = 0; r <= repetitions; r++) {
+                qasmparser::CompileStats stats;
+                qasmparser::parseCircuit(path, 3, Backend::Sequential, true, std::nullopt, std::nullopt,
+                                         qasmparser::CoefficientInputs::Off, qasmparser::CancellationToken(), &stats);
+                for (std::size_t ph = 0; r > 0 && ph < phases.size(); ph++)
+                    samples[ph].push_back(stats.*phases[ph].second);
+            }
+            for (std::size_t ph = 0; ph < phases.size(); ph++)
+                times[ph].push_back(std::max(median(samples[ph]), 1e-9));
+        }
+
+        for (std::size_t ph = 0; ph < phases.size(); ph++) {
+            const double largest = times[ph].back();
+            const double k = exponent(sizes, times[ph]);
+            const bool measurable = largest >= minSeconds;
+            const bool pass = !measurable || k <= threshold;
+            failed = failed || !pass;
+            fmt::print("{:<10}{:<10}{:>14.2f}{:>12.2f}{:>10.2f}  {}\n", sweep.name, phases[ph].first,
+                       largest * 1e3, k, threshold, !measurable ? "too fast" : pass ? "ok" : "FAIL");
+        }
+    }
+
+    std::remove(path.c_str());
+    if (failed) {
+        fmt::print(stderr, "Phases scale worse than size^{}!\n", threshold);
+        return 1;
+    }
+    return 0;
+}
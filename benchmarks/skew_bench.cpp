@@ -0,0 +1,186 @@
+//
+// Tail latency of the emission on skewed Pauli weights: in-order chunks against weight-aware scheduling.
+//
+
+#include "generator.h"
+#include "parser.h"
+#include "trace.h"
+#include "fmt/core.h"
+
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace qasmparser {
+    /**
+     * The emission of `Parser::emit`, but cut in order by the grain size of the plain `ThreadPool::schedule` instead
+     * of cost-balanced chunks.
+     */
+    struct PhaseAccess {
+        static Schedule inOrderSchedule(const Parser &p, const Backend backend) {
+            return threadPool()->schedule(backend, p.operators.size(), p.totalWeight + p.operators.size(),
+                                          p.maxWeight + 1);
+        }
+
+        static std::string emitInOrder(const Parser &p, const Backend backend) {
+            std::string qasm;
+            const auto angle = p.emission(3, true, std::nullopt, CoefficientInputs::Off, qasm);
+
+            const Schedule schedule = inOrderSchedule(p, backend);
+            std::vector<Parser::QasmFragment> fragments(p.operators.size());
+            threadPool()->forEach(schedule, p.operators.begin(), p.operators.end(),
+                                  [&](const Parser::QuantumOperator &op) {
+                auto &fragment = fragments[&op - p.operators.data()];
+                fragment.angleOffset = Parser::parseOpToQasm(op, angle(op), fragment.qasm, schedule.backend);
+            }, "emit operators");
+
+            Parser::assemble(qasm, fragments);
+            return qasm;
+        }
+    };
+}
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    using qasmparser::Backend;
+
+    struct Result {
+        double wall;                                         // Wall time of the emission in ms
+        double slowest;                                      // Longest chunk of the emission loop in ms
+        double tail;                                         // Last minus first thread to finish its chunks in ms
+    };
+
+    /**
+     * Write weight-2 terms with the heavy terms at random positions, all on the same qubits.
+     * @param path Output file
+     * @param qubits Length of every Pauli string
+     * @param light Number of weight-2 terms
+     * @param heavy Number of heavy terms
+     * @param heavyWeight Pauli weight of the heavy terms, at most `qubits`
+     */
+    void writeSkewed(const std::string &path, const unsigned long qubits, const std::size_t light,
+                     const std::size_t heavy, const std::size_t heavyWeight) {
+        auto lines = [](const qasmparser::GeneratorOptions &options) {
+            std::vector<std::string> out;
+            std::istringstream text(qasmparser::generateHamiltonian(options));
+            for (std::string line; std::getline(text, line);)
+                out.push_back(std::move(line));
+            return out;
+        };
+
+        qasmparser::GeneratorOptions options;
+        options.family = qasmparser::HamiltonianFamily::FixedWeight;
+        options.qubits = qubits;
+        options.terms = light;
+        options.minWeight = options.maxWeight = 2;
+        auto terms = lines(options);
+
+        options.terms = heavy;
+        options.minWeight = options.maxWeight = heavyWeight;
+        options.seed = 2;
+        std::mt19937_64 rng(42);
+        for (auto &line : lines(options))
+            terms.insert(terms.begin() + static_cast<std::ptrdiff_t>(rng() % (terms.size() + 1)), std::move(line));
+
+        std::ofstream out(path);
+        for (const auto &line : terms)
+            out << line << '\n';
+    }
+
+    /**
+     * Run an emission inside a trace session and take the chunks of its operator loop from the trace.
+     * @param emit Runs the emission
+     * @param qasm Set to the representation emitted
+     */
+    template <typename Emit>
+    Result measure(const Emit &emit, std::string &qasm) {
+        qasmparser::TraceSession session;
+        const auto start = Clock::now();
+        qasm = emit();
+        const double wall = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        const std::string trace = session.finish();
+
+        // Complete events of the chunks, the time the last chunk of each thread ends
+        constexpr const char *chunk = "{\"name\":\"emit operators\",\"ph\":\"X\",";
+        double slowest = 0;
+        std::map<unsigned long, double> finish;
+        for (auto pos = trace.find(chunk); pos != std::string::npos; pos = trace.find(chunk, pos + 1)) {
+            unsigned long pid, tid;
+            double ts, dur;
+            if (std::sscanf(trace.c_str() + pos + std::strlen(chunk), "\"pid\":%lu,\"tid\":%lu,\"ts\":%lf,\"dur\":%lf",
+                            &pid, &tid, &ts, &dur) != 4)
+                continue;
+            slowest = std::max(slowest, dur);
+            finish[tid] = std::max(finish[tid], ts + dur);
+        }
+
+        double first = 0, last = 0;
+        for (const auto &[tid, end] : finish) {
+            first = first == 0 ? end : std::min(first, end);
+            last = std::max(last, end);
+        }
+        return {wall, slowest / 1000, (last - first) / 1000};
+    }
+}
+
+/**
+ * Usage: qasm_skew_bench [light terms] [heavy terms] [heavy weight] [qubits] [repetitions]
+ * Generates weight-2 terms with a few heavy terms among them and emits them with `Parser::emit`, whose operator loop
+ * runs in cost-balanced chunks, and with the same emission cut in order by the plain schedule. The thread count is
+ * taken from QASMPARSER_NUM_THREADS. Exits with 1 if the two emissions differ.
+ */
+int main(int argc, char **argv) {
+    const std::size_t light = argc > 1 ? std::stoul(argv[1]) : 200000;
+    const std::size_t heavy = argc > 2 ? std::stoul(argv[2]) : 16;
+    const std::size_t heavyWeight = argc > 3 ? std::stoul(argv[3]) : 512;
+    const unsigned long qubits = argc > 4 ? std::stoul(argv[4]) : 512;
+    const int repetitions = argc > 5 ? std::stoi(argv[5]) : 5;
+
+    const auto path = (std::filesystem::temp_directory_path() / fmt::format("qasm_skew_{}.txt", ::getpid())).string();
+    writeSkewed(path, qubits, light, heavy, heavyWeight);
+    const qasmparser::Parser parser(path, Backend::Auto);
+    std::remove(path.c_str());
+
+    const auto pool = qasmparser::threadPool();
+    fmt::print("{} terms, {} of weight {}, {} threads\n", light + heavy, heavy, heavyWeight, pool->size());
+    fmt::print("{:<18}{:<18}{:>8}{:>12}{:>14}{:>12}\n", "backend", "scheduling", "chunks", "wall [ms]",
+               "slowest [ms]", "tail [ms]");
+
+    bool identical = true;
+    for (const auto backend : {Backend::OpenMP, Backend::ExecutionPolicy}) {
+        const char *name = backend == Backend::OpenMP ? "OpenMP" : "ExecutionPolicy";
+        const auto plain = qasmparser::PhaseAccess::inOrderSchedule(parser, backend);
+        const auto weighted = parser.schedule(backend);
+
+        Result inOrder{1e300, 1e300, 1e300}, balanced{1e300, 1e300, 1e300};
+        for (int r = 0; r < repetitions; r++) {
+            std::string a, b;
+            const auto x = measure([&] { return qasmparser::PhaseAccess::emitInOrder(parser, backend); }, a);
+            const auto y = measure([&] { return parser.emit(3, backend); }, b);
+            identical = identical && a == b;
+            inOrder = {std::min(inOrder.wall, x.wall), std::min(inOrder.slowest, x.slowest),
+                       std::min(inOrder.tail, x.tail)};
+            balanced = {std::min(balanced.wall, y.wall), std::min(balanced.slowest, y.slowest),
+                        std::min(balanced.tail, y.tail)};
+        }
+
+        fmt::print("{:<18}{:<18}{:>8}{:>12.2f}{:>14.2f}{:>12.2f}\n", name, "in order", plain.chunks,
+                   inOrder.wall, inOrder.slowest, inOrder.tail);
+        fmt::print("{:<18}{:<18}{:>8}{:>12.2f}{:>14.2f}{:>12.2f}\n", name, "weight-aware", weighted.chunks,
+                   balanced.wall, balanced.slowest, balanced.tail);
+    }
+
+    if (!identical)
+        fmt::print(stderr, "In-order and weight-aware emission differ!\n");
+    return identical ? 0 : 1;
+}